@@ -0,0 +1,780 @@
+// (c) 2022. Taras Mykhailovych. "Prywit Research Labs"
+// `pw-bench`: benchmark scenarios of `pw-iter` and `pw-async`
+// Usage: pw-bench [-f csv|json] [-o file] [-s scale] [-r filter] [-b baseline.csv] [-t threshold%] [-l]
+//   - each scenario reports ops/s and percentiles of latency per op (ns);
+//     throughput scenarios sample latency per batch of ops, others per op.
+//   - with `-b`, results are compared with saved CSV output; exits with 1, if any scenario
+//     is slower than baseline by more than threshold (10% by default).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "pw-async.h"
+
+// latency samples
+
+typedef struct Samples {
+  unsigned long long *ns;
+  size_t n, nAlloc;
+} Samples;
+
+static void sample(Samples *s, unsigned long long ns) {
+  if (s->n == s->nAlloc) {
+    size_t nAlloc = s->nAlloc ? s->nAlloc << 1 : 1024;
+    unsigned long long *p = (unsigned long long *) realloc(s->ns, nAlloc * sizeof(*p));
+    if (!p) return;
+    s->ns = p;
+    s->nAlloc = nAlloc;
+  }
+  s->ns[s->n++] = ns;
+}
+
+static int cmpSamples(const void *a, const void *b) {
+  unsigned long long x = *(unsigned long long *) a, y = *(unsigned long long *) b;
+  return x < y ? -1 : x > y;
+}
+
+static unsigned long long percentile(Samples *s, double p) {
+  if (!s->n) return 0;
+  size_t i = (size_t) (p * (s->n - 1) + 0.5);
+  return s->ns[i];
+}
+
+static inline unsigned long long nowNsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned long long sinceNsec(struct timespec *until) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return pwa_timespec_cmp(&now, until) <= 0 ? 0 : pwa_timespec_diff_sec(&now, until) * 1e9;
+}
+
+#define benchBatch 4096
+
+// timed section of a scenario
+typedef struct Result {
+  long long ops;
+  unsigned long long nsec;
+} Result;
+
+typedef Result (*BenchFunc)(int param, long long n, Samples *lat);
+
+// iterator chains: `Range` piped through `depth` of `Add` iterators
+
+pwi_func((int), Range, (int start, end), (
+  int i;
+)) {
+  for (_->i = _->start; _->i < _->end; ++_->i) {
+    pwi_yield(_->i);
+  }
+} pwi_end_func
+
+pwi_iterator((int), IntIterator);
+
+pwi_func((int), Add, (IntIterator *iter; int delta), (
+  int i;
+)) {
+  pwi_for_s(_->i, *_->iter) {
+    pwi_yield(_->i + _->delta);
+  } pwi_end_for_s(*_->iter)
+} pwi_end_func
+
+#define benchMaxDepth 16
+
+static Result benchChain(int depth, long long n, Samples *lat) {
+  Range range = pwi_iterate(Range, (0, (int) n));
+  Add adds[benchMaxDepth];
+  IntIterator *iter = (IntIterator *) &range;
+  for (int i = 0; i < depth; ++i) {
+    adds[i] = pwi_iterate(Add, (iter, 1));
+    iter = (IntIterator *) (adds + i);
+  }
+
+  volatile int sum = 0;
+  long long ops = 0;
+  unsigned long long start = nowNsec(), batch = start;
+  while (!iter->next(iter, 0)->done) {
+    sum += iter->value;
+    if (!(++ops % benchBatch)) {
+      unsigned long long now = nowNsec();
+      sample(lat, (now - batch) / benchBatch);
+      batch = now;
+    }
+  }
+  return (Result) { ops, nowNsec() - start };
+}
+
+// `pwi_yield` throughput by value type
+
+typedef struct Pair { long long a, b; } Pair;
+typedef struct Block { long long a[8]; } Block;
+
+#define benchYieldFunc(type, name, make) \
+  pwi_func(type, name, (long long n), ( \
+    long long i; \
+  )) { \
+    for (_->i = 0; _->i < _->n; ++_->i) { \
+      pwi_yield(make); \
+    } \
+  } pwi_end_func \
+  \
+  static Result bench ## name(int param, long long n, Samples *lat) { \
+    name iter = pwi_iterate(name, (n)); \
+    volatile char sink; \
+    long long ops = 0; \
+    unsigned long long start = nowNsec(), batch = start; \
+    while (!pwi_next(iter)->done) { \
+      sink = *(char *) &iter.value; \
+      if (!(++ops % benchBatch)) { \
+        unsigned long long now = nowNsec(); \
+        sample(lat, (now - batch) / benchBatch); \
+        batch = now; \
+      } \
+    } \
+    (void) sink; \
+    return (Result) { ops, nowNsec() - start }; \
+  }
+
+benchYieldFunc((char), YieldChar, (char) _->i)
+benchYieldFunc((int), YieldInt, (int) _->i)
+benchYieldFunc((double), YieldDouble, (double) _->i)
+benchYieldFunc((void *), YieldPtr, (void *) _->i)
+benchYieldFunc((Pair), YieldPair, ((Pair) { _->i, _->i }))
+benchYieldFunc((Block), YieldBlock, ((Block) { { _->i } }))
+
+// `pwa_delay`: many timers pending at once; latency is lateness of wakeup
+
+static pwa_EventLoop loop;
+
+pwa_func((int), Sleep, (double sec; Samples *lat), ()) {
+  pwa_delay(_->sec);
+  sample(_->lat, sinceNsec(&_->_pwa_timer.until));
+} pwa_end_func
+
+static Result benchDelay(int backend, long long n, Samples *lat) {
+  Sleep *jobs = (Sleep *) malloc(n * sizeof(Sleep));
+  if (!jobs) return (Result) { 0, 0 };
+  pwa_loop_init_config(loop, (.backend = (char) backend));
+  unsigned long long start = nowNsec();
+  for (long long i = 0; i < n; ++i) {
+    jobs[i] = pwa_iterate(Sleep, ((i * 7919 % 1000) * 1e-4, lat)); // up to 100 ms, scattered
+    pwa_loop_async_job(loop, jobs[i]);
+    if (!(i % benchBatch)) pwa_EventLoop_updateNow(&loop); // as if jobs came over several turns
+  }
+  pwa_loop_run(loop);
+  Result res = { n, nowNsec() - start };
+  pwa_loop_free(loop);
+  free(jobs);
+  return res;
+}
+
+// ping-pong over socket pairs: each pinger sends a byte and awaits the echo
+
+#define benchFds 10000
+
+pwa_func((int), Ping, (int fd; int rounds; Samples *lat), (
+  int i;
+  char c;
+  ssize_t r;
+  unsigned long long sent;
+)) {
+  for (_->i = 0; _->i < _->rounds; ++_->i) {
+    _->sent = nowNsec();
+    pwa_write(_->r, _->fd, "p", 1);
+    pwa_read(_->r, _->fd, &_->c, 1);
+    sample(_->lat, nowNsec() - _->sent);
+  }
+} pwa_finally {
+  close(_->fd);
+} pwa_end_func
+
+pwa_func((int), Pong, (int fd), (
+  char c;
+  ssize_t r;
+)) {
+  while (1) {
+    pwa_read(_->r, _->fd, &_->c, 1);
+    if (!_->r) break;
+    pwa_write(_->r, _->fd, &_->c, 1);
+  }
+} pwa_finally {
+  close(_->fd);
+} pwa_end_func
+
+static Result benchPingPong(int backend, long long n, Samples *lat) {
+  struct rlimit lim;
+  int nPairs = benchFds / 2;
+  if (!getrlimit(RLIMIT_NOFILE, &lim) && lim.rlim_cur < benchFds + 64) nPairs = (lim.rlim_cur - 64) / 2;
+  if (nPairs < 1) return (Result) { 0, 0 };
+  int rounds = n / nPairs > 0 ? n / nPairs : 1;
+
+  Ping *pings = (Ping *) malloc(nPairs * sizeof(Ping));
+  Pong *pongs = (Pong *) malloc(nPairs * sizeof(Pong));
+  if (!pings || !pongs) { free(pings); free(pongs); return (Result) { 0, 0 }; }
+  pwa_loop_init_config(loop, (.backend = (char) backend));
+  int i = 0;
+  for (; i < nPairs; ++i) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds)) break;
+    pings[i] = pwa_iterate(Ping, (fds[0], rounds, lat));
+    pongs[i] = pwa_iterate(Pong, (fds[1]));
+  }
+  nPairs = i;
+
+  unsigned long long start = nowNsec();
+  for (i = 0; i < nPairs; ++i) {
+    pwa_loop_async_job(loop, pongs[i]);
+    pwa_loop_async_job(loop, pings[i]);
+  }
+  pwa_loop_run(loop);
+  Result res = { (long long) nPairs * rounds, nowNsec() - start };
+  pwa_loop_free(loop);
+  free(pings);
+  free(pongs);
+  return res;
+}
+
+// ping-pong with timeout on each echo: by a watchdog job, which finishes the pinger on expiry and is killed
+// by it otherwise (two registrations, two jobs to run), vs. `pwa_await_fd_timeout` (one action, one job)
+
+#define benchTimeoutSec 10.0
+
+pwa_func((int), Watchdog, (pwa_Iterator *job), ()) {
+  pwa_delay(benchTimeoutSec);
+  pwa_job_finish(*_->job);
+} pwa_end_func
+
+pwa_func((int), TimedPing, (int fd; int rounds; char deadline; pwa_Iterator *self; Samples *lat), (
+  int i, rev;
+  char c;
+  ssize_t r;
+  unsigned long long sent;
+  Watchdog watchdogs[2]; // by round parity: the one killed in a round isn't reinitialized in the next
+)) {
+  for (_->i = 0; _->i < _->rounds; ++_->i) {
+    _->sent = nowNsec();
+    pwa_write(_->r, _->fd, "p", 1);
+    if (_->deadline) {
+      pwa_await_fd_timeout(_->rev, _->fd, POLLIN, benchTimeoutSec);
+    } else {
+      _->watchdogs[_->i & 1] = pwa_iterate(Watchdog, (_->self));
+      pwa_async_job(_->watchdogs[_->i & 1]);
+      pwa_await_fd_res(_->rev, _->fd, POLLIN);
+      pwa_job_kill(_->watchdogs[_->i & 1]);
+    }
+    if (!_->rev || read(_->fd, &_->c, 1) != 1) break;
+    sample(_->lat, nowNsec() - _->sent);
+  }
+} pwa_finally {
+  close(_->fd);
+} pwa_end_func
+
+static Result benchTimeout(int deadline, long long n, Samples *lat) {
+  struct rlimit lim;
+  int nPairs = benchFds / 2;
+  if (!getrlimit(RLIMIT_NOFILE, &lim) && lim.rlim_cur < benchFds + 64) nPairs = (lim.rlim_cur - 64) / 2;
+  if (nPairs < 1) return (Result) { 0, 0 };
+  int rounds = n / nPairs > 0 ? n / nPairs : 1;
+
+  TimedPing *pings = (TimedPing *) malloc(nPairs * sizeof(TimedPing));
+  Pong *pongs = (Pong *) malloc(nPairs * sizeof(Pong));
+  if (!pings || !pongs) { free(pings); free(pongs); return (Result) { 0, 0 }; }
+  pwa_loop_init_config(loop, (.backend = pwa_Backend_epoll));
+  int i = 0;
+  for (; i < nPairs; ++i) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds)) break;
+    pings[i] = pwa_iterate(TimedPing, (fds[0], rounds, (char) deadline, (pwa_Iterator *) (pings + i), lat));
+    pongs[i] = pwa_iterate(Pong, (fds[1]));
+  }
+  nPairs = i;
+
+  unsigned long long start = nowNsec();
+  for (i = 0; i < nPairs; ++i) {
+    pwa_loop_async_job(loop, pongs[i]);
+    pwa_loop_async_job(loop, pings[i]);
+  }
+  pwa_loop_run(loop);
+  Result res = { (long long) nPairs * rounds, nowNsec() - start };
+  pwa_loop_free(loop);
+  free(pings);
+  free(pongs);
+  return res;
+}
+
+// TCP echo over loopback: server accepts with `pwa_Accept` and echoes each connection by its own job;
+// clients send fixed-size requests one at a time, latency is per request
+
+#define benchConns 10000
+#define benchEchoSize 32
+#define benchConnectBatch 1024 // clients connecting per turn; more would overflow accept backlog
+
+pwa_func((int), Echo, (int fd), (
+  char buf[benchEchoSize];
+  ssize_t n, w, off;
+)) {
+  while (1) {
+    pwa_recv(_->n, _->fd, _->buf, sizeof(_->buf), 0);
+    if (!_->n) break;
+    for (_->off = 0; _->off < _->n; _->off += _->w) {
+      pwa_send(_->w, _->fd, _->buf + _->off, _->n - _->off, 0);
+    }
+  }
+} pwa_finally {
+  close(_->fd);
+} pwa_end_func
+
+pwa_func((int), EchoServer, (int fd; int nConns; Echo *echos), (
+  pwa_Accept accept;
+  int i, conn;
+)) {
+  _->accept = pwa_iterate(pwa_Accept, (_->fd, 1));
+  pwa_for(_->conn, _->accept) {
+    _->echos[_->i] = pwa_iterate(Echo, (_->conn));
+    pwa_async_job(_->echos[_->i]);
+    if (++_->i == _->nConns) break;
+  } pwa_end_for(_->accept)
+} pwa_finally {
+  close(_->fd);
+} pwa_end_func
+
+pwa_func((int), EchoClient, (struct sockaddr_in *addr; int id, rounds; Samples *lat), (
+  int fd, i;
+  char buf[benchEchoSize];
+  ssize_t n, off;
+  unsigned long long sent;
+)) {
+  pwa_delay(_->id / benchConnectBatch * 1e-3);
+  _->fd = pwa_Socket_tcp(AF_INET);
+  if (_->fd == -1) { pwa_throw(pwa_error(pwa_Io, connect)); }
+  pwa_connect(_->fd, _->addr, sizeof(*_->addr));
+  memset(_->buf, 'e', sizeof(_->buf));
+  for (_->i = 0; _->i < _->rounds; ++_->i) {
+    _->sent = nowNsec();
+    for (_->off = 0; _->off < benchEchoSize; _->off += _->n) {
+      pwa_send(_->n, _->fd, _->buf + _->off, benchEchoSize - _->off, 0);
+    }
+    for (_->off = 0; _->off < benchEchoSize; _->off += _->n) {
+      pwa_recv(_->n, _->fd, _->buf + _->off, benchEchoSize - _->off, 0);
+      if (!_->n) { errno = ECONNRESET; pwa_throw(pwa_error(pwa_Io, recv)); }
+    }
+    sample(_->lat, nowNsec() - _->sent);
+  }
+} pwa_finally {
+  if (_->fd > 0) close(_->fd);
+} pwa_end_func
+
+static Result benchEcho(int backend, long long n, Samples *lat) {
+  struct rlimit lim;
+  int nConns = benchConns;
+  if (!getrlimit(RLIMIT_NOFILE, &lim) && lim.rlim_cur < 2 * benchConns + 64) nConns = (lim.rlim_cur - 64) / 2;
+  if (nConns < 1) return (Result) { 0, 0 };
+  int rounds = n / nConns > 0 ? n / nConns : 1;
+
+  struct sockaddr_in addr;
+  socklen_t addrLen = sizeof(addr);
+  pwa_Socket_addr4(&addr, "127.0.0.1", 0);
+  int fd = pwa_Socket_listen((struct sockaddr *) &addr, &addrLen, benchConnectBatch * 4);
+  if (fd == -1) return (Result) { 0, 0 };
+
+  Echo *echos = (Echo *) malloc(nConns * sizeof(Echo));
+  EchoClient *clients = (EchoClient *) malloc(nConns * sizeof(EchoClient));
+  if (!echos || !clients) { free(echos); free(clients); close(fd); return (Result) { 0, 0 }; }
+  EchoServer server = pwa_iterate(EchoServer, (fd, nConns, echos));
+  pwa_loop_init_config(loop, (.backend = (char) backend));
+
+  unsigned long long start = nowNsec();
+  pwa_loop_async_job(loop, server);
+  for (int i = 0; i < nConns; ++i) {
+    clients[i] = pwa_iterate(EchoClient, (&addr, i, rounds, lat));
+    pwa_loop_async_job(loop, clients[i]);
+  }
+  pwa_loop_run(loop);
+  Result res = { (long long) lat->n, nowNsec() - start };
+  pwa_loop_free(loop);
+  free(echos);
+  free(clients);
+  return res;
+}
+
+// UDP over loopback: bursts of datagrams sent and received one per syscall (`naive`),
+// or batched by `pwa_send_datagrams` and `pwa_RecvDatagrams` (`batch`); latency is per datagram sent
+
+#define benchUdpSize 64
+#define benchUdpBurst 64
+#define benchUdpRcvBuf (8 << 20)
+
+pwa_func((int), UdpRecv, (int fd; char batched; long long *nRecv), (
+  pwa_RecvDatagrams recv;
+  pwa_Datagrams batch, *got;
+  char buf[benchUdpSize];
+  ssize_t n;
+)) {
+  if (!_->batched) {
+    while (1) {
+      pwa_recv(_->n, _->fd, _->buf, sizeof(_->buf), 0);
+      ++*_->nRecv;
+    }
+  }
+  if (pwa_Datagrams_init(&_->batch, benchUdpBurst, benchUdpSize)) { pwa_throw(pwa_error(pwa_Io, recv)); }
+  _->recv = pwa_iterate(pwa_RecvDatagrams, (_->fd, &_->batch, 0));
+  pwa_for(_->got, _->recv) {
+    *_->nRecv += _->got->n;
+  } pwa_end_for(_->recv)
+} pwa_finally {
+  if (_->batch.msgs) pwa_Datagrams_free(&_->batch);
+} pwa_end_func
+
+pwa_func((int), UdpSend, (int fd; char batched; long long n; UdpRecv *recv; Samples *lat), (
+  pwa_Datagrams batch;
+  char buf[benchUdpSize];
+  long long i;
+  int j;
+  ssize_t w;
+  unsigned long long start;
+)) {
+  memset(_->buf, 'u', sizeof(_->buf));
+  if (_->batched && pwa_Datagrams_init(&_->batch, benchUdpBurst, benchUdpSize)) { pwa_throw(pwa_error(pwa_Io, send)); }
+  for (_->i = 0; _->i < _->n; _->i += benchUdpBurst) {
+    _->start = nowNsec();
+    if (_->batched) {
+      for (_->j = 0; _->j < benchUdpBurst; ++_->j) pwa_Datagrams_add(&_->batch, _->buf, sizeof(_->buf), 0, 0);
+      pwa_send_datagrams(_->fd, &_->batch)
+    } else {
+      for (_->j = 0; _->j < benchUdpBurst; ++_->j) {
+        pwa_send(_->w, _->fd, _->buf, sizeof(_->buf), 0);
+      }
+    }
+    sample(_->lat, (nowNsec() - _->start) / benchUdpBurst);
+    pwa_delay(0); // let receiver drain the burst
+  }
+  pwa_delay(0.01);
+  pwa_job_finish(*_->recv);
+} pwa_finally {
+  if (_->batch.msgs) pwa_Datagrams_free(&_->batch);
+} pwa_end_func
+
+static Result benchUdp(int batched, long long n, Samples *lat) {
+  int fds[2];
+  struct sockaddr_in addr[2];
+  socklen_t addrLen = sizeof(addr[0]);
+  for (int i = 0; i < 2; ++i) {
+    fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    pwa_Socket_addr4(addr + i, "127.0.0.1", 0);
+    if (fds[i] == -1 || bind(fds[i], (struct sockaddr *) (addr + i), addrLen)) return (Result) { 0, 0 };
+    getsockname(fds[i], (struct sockaddr *) (addr + i), &addrLen);
+    pwa_Socket_setNonBlock(fds[i]);
+  }
+  int rcvBuf = benchUdpRcvBuf;
+  setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+  connect(fds[0], (struct sockaddr *) (addr + 1), addrLen);
+
+  long long nRecv = 0;
+  UdpRecv recv = pwa_iterate(UdpRecv, (fds[1], (char) batched, &nRecv));
+  UdpSend send = pwa_iterate(UdpSend, (fds[0], (char) batched, n, &recv, lat));
+  pwa_loop_init_config(loop, (.backend = pwa_Backend_epoll));
+  unsigned long long start = nowNsec();
+  pwa_loop_async_job(loop, recv);
+  pwa_loop_async_job(loop, send);
+  pwa_loop_run(loop);
+  Result res = { nRecv, nowNsec() - start };
+  pwa_loop_free(loop);
+  close(fds[0]);
+  close(fds[1]);
+  return res;
+}
+
+// producer and consumer jobs passing `long long` items through a channel of `cap` items, or a pipe (`cap` = 0)
+// one item per syscall; latency is per item, averaged over `benchBatch` ones
+
+pwa_func((int), ChanProd, (pwa_Chan *chan; int fd; long long n), (
+  long long i;
+  ssize_t w;
+  int ok;
+)) {
+  for (_->i = 0; _->i < _->n; ++_->i) {
+    if (_->chan) {
+      pwa_chan_send(_->ok, _->chan, &_->i);
+    } else {
+      pwa_write(_->w, _->fd, &_->i, sizeof(_->i));
+    }
+  }
+  if (_->chan) pwa_chan_close(_->chan)
+  else close(_->fd);
+} pwa_end_func
+
+pwa_func((int), ChanCons, (pwa_Chan *chan; int fd; Samples *lat), (
+  long long item, n;
+  ssize_t r;
+  int ok;
+  unsigned long long batch;
+)) {
+  _->batch = nowNsec();
+  while (1) {
+    if (_->chan) {
+      pwa_chan_recv(_->ok, _->chan, &_->item);
+      if (!_->ok) break;
+    } else {
+      pwa_read(_->r, _->fd, &_->item, sizeof(_->item));
+      if (!_->r) break;
+    }
+    if (!(++_->n % benchBatch)) {
+      unsigned long long now = nowNsec();
+      sample(_->lat, (now - _->batch) / benchBatch);
+      _->batch = now;
+    }
+  }
+} pwa_finally {
+  if (!_->chan) close(_->fd);
+} pwa_end_func
+
+static Result benchChan(int cap, long long n, Samples *lat) {
+  pwa_Chan chan, *pChan = 0;
+  int fds[2] = { -1, -1 };
+  if (cap) {
+    if (pwa_Chan_init(&chan, cap, sizeof(long long))) return (Result) { 0, 0 };
+    pChan = &chan;
+  } else {
+    if (pipe(fds)) return (Result) { 0, 0 };
+    pwa_Socket_setNonBlock(fds[0]);
+    pwa_Socket_setNonBlock(fds[1]);
+  }
+  ChanProd prod = pwa_iterate(ChanProd, (pChan, fds[1], n));
+  ChanCons cons = pwa_iterate(ChanCons, (pChan, fds[0], lat));
+  pwa_loop_init_config(loop, (.backend = pwa_Backend_epoll));
+  unsigned long long start = nowNsec();
+  pwa_loop_async_job(loop, cons);
+  pwa_loop_async_job(loop, prod);
+  pwa_loop_run(loop);
+  Result res = { n, nowNsec() - start };
+  pwa_loop_free(loop);
+  if (pChan) pwa_Chan_free(pChan);
+  return res;
+}
+
+// hits of parked jobs: one by one (`hitJob`), and all at once (`hitAllJobs`) along with their finalization
+
+pwa_func((int), Parked, (), ()) {
+  pwa_delay(1e6);
+} pwa_end_func
+
+#define benchHitBatch 256
+
+static Result benchHitJob(int backend, long long n, Samples *lat) {
+  Parked *jobs = (Parked *) malloc(n * sizeof(Parked));
+  if (!jobs) return (Result) { 0, 0 };
+  pwa_loop_init_config(loop, (.backend = (char) backend));
+  for (long long i = 0; i < n; ++i) {
+    jobs[i] = pwa_iterate(Parked, ());
+    pwa_loop_async_job(loop, jobs[i]);
+  }
+  unsigned long long start = nowNsec(), batch = start;
+  for (long long i = 0; i < n; ++i) {
+    pwa_loop_job_finish(loop, jobs[i]);
+    if (!((i + 1) % benchHitBatch)) {
+      unsigned long long now = nowNsec();
+      sample(lat, (now - batch) / benchHitBatch);
+      batch = now;
+    }
+  }
+  Result res = { n, nowNsec() - start };
+  pwa_loop_run(loop);
+  pwa_loop_free(loop);
+  free(jobs);
+  return res;
+}
+
+#define benchHitAllRounds 16
+
+static Result benchHitAllJobs(int backend, long long n, Samples *lat) {
+  long long perRound = n / benchHitAllRounds > 0 ? n / benchHitAllRounds : 1;
+  Parked *jobs = (Parked *) malloc(perRound * sizeof(Parked));
+  if (!jobs) return (Result) { 0, 0 };
+  pwa_loop_init_config(loop, (.backend = (char) backend));
+  Result res = { 0, 0 };
+  for (int r = 0; r < benchHitAllRounds; ++r) {
+    for (long long i = 0; i < perRound; ++i) {
+      jobs[i] = pwa_iterate(Parked, ());
+      pwa_loop_async_job(loop, jobs[i]);
+    }
+    unsigned long long start = nowNsec();
+    pwa_loop_all_jobs_finish(loop);
+    pwa_loop_run(loop);
+    unsigned long long nsec = nowNsec() - start;
+    sample(lat, nsec / perRound);
+    res.ops += perRound;
+    res.nsec += nsec;
+  }
+  pwa_loop_free(loop);
+  free(jobs);
+  return res;
+}
+
+// scenarios
+
+typedef struct Bench {
+  const char *name;
+  BenchFunc func;
+  int param;
+  long long n; // ops at scale 1
+} Bench;
+
+static Bench benches[] = {
+  { "chain/depth=0", benchChain, 0, 100000000 },
+  { "chain/depth=1", benchChain, 1, 50000000 },
+  { "chain/depth=2", benchChain, 2, 50000000 },
+  { "chain/depth=4", benchChain, 4, 20000000 },
+  { "chain/depth=8", benchChain, 8, 10000000 },
+  { "chain/depth=14", benchChain, 14, 10000000 },
+  { "yield/char", benchYieldChar, 0, 100000000 },
+  { "yield/int", benchYieldInt, 0, 100000000 },
+  { "yield/double", benchYieldDouble, 0, 100000000 },
+  { "yield/ptr", benchYieldPtr, 0, 100000000 },
+  { "yield/pair16", benchYieldPair, 0, 100000000 },
+  { "yield/block64", benchYieldBlock, 0, 50000000 },
+  { "delay/poll/timers=1M", benchDelay, pwa_Backend_poll, 1000000 },
+  { "pingpong/poll/fds=10k", benchPingPong, pwa_Backend_poll, 1000000 },
+  { "pingpong/epoll/fds=10k", benchPingPong, pwa_Backend_epoll, 1000000 },
+  { "pingpong/uring/fds=10k", benchPingPong, pwa_Backend_uring, 1000000 },
+  { "timeout/jobs/fds=10k", benchTimeout, 0, 1000000 },
+  { "timeout/deadline/fds=10k", benchTimeout, 1, 1000000 },
+  { "echo/poll/conns=10k", benchEcho, pwa_Backend_poll, 1000000 },
+  { "echo/epoll/conns=10k", benchEcho, pwa_Backend_epoll, 1000000 },
+  { "echo/uring/conns=10k", benchEcho, pwa_Backend_uring, 1000000 },
+  { "udp/naive", benchUdp, 0, 10000000 },
+  { "udp/batch", benchUdp, 1, 10000000 },
+  { "chan/pipe", benchChan, 0, 10000000 },
+  { "chan/cap=1", benchChan, 1, 100000000 },
+  { "chan/cap=64", benchChan, 64, 100000000 },
+  { "hitJob/jobs=1M", benchHitJob, pwa_Backend_poll, 1000000 },
+  { "hitAllJobs/jobs=1M", benchHitAllJobs, pwa_Backend_poll, 1000000 },
+};
+
+#define nBenches ((int) (sizeof(benches) / sizeof(Bench)))
+
+typedef struct Report {
+  const char *name;
+  long long ops;
+  double sec, opsPerSec;
+  unsigned long long p50, p90, p99, max;
+} Report;
+
+static void printCsvHeader(FILE *out) {
+  fprintf(out, "name,ops,sec,ops_per_sec,p50_ns,p90_ns,p99_ns,max_ns\n");
+}
+
+static void printReport(FILE *out, Report *r, char json, int i) {
+  if (json) {
+    fprintf(out, "%s\n  {\"name\": \"%s\", \"ops\": %lld, \"sec\": %.6f, \"ops_per_sec\": %.1f, "
+      "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}",
+      i ? "," : "", r->name, r->ops, r->sec, r->opsPerSec, r->p50, r->p90, r->p99, r->max);
+  } else {
+    fprintf(out, "%s,%lld,%.6f,%.1f,%llu,%llu,%llu,%llu\n",
+      r->name, r->ops, r->sec, r->opsPerSec, r->p50, r->p90, r->p99, r->max);
+  }
+  fflush(out);
+}
+
+// baseline: CSV output of previous run
+
+typedef struct Baseline {
+  char name[64];
+  double opsPerSec;
+  unsigned long long p99;
+} Baseline;
+
+static int readBaseline(const char *path, Baseline *base, int nMax) {
+  FILE *in = fopen(path, "r");
+  if (!in) return -1;
+  char line[256];
+  int n = 0;
+  while (n < nMax && fgets(line, sizeof(line), in)) {
+    Baseline *b = base + n;
+    if (sscanf(line, "%63[^,],%*d,%*f,%lf,%*u,%*u,%llu", b->name, &b->opsPerSec, &b->p99) == 3) ++n;
+  }
+  fclose(in);
+  return n;
+}
+
+static int compareBaseline(Report *r, Baseline *base, int nBase, double threshold) {
+  for (int i = 0; i < nBase; ++i) {
+    if (strcmp(base[i].name, r->name) || base[i].opsPerSec <= 0) continue;
+    double delta = (r->opsPerSec / base[i].opsPerSec - 1) * 100;
+    int slower = delta < -threshold;
+    fprintf(stderr, "%-26s %14.1f -> %14.1f ops/s %+7.1f%%  p99 %llu -> %llu ns%s\n",
+      r->name, base[i].opsPerSec, r->opsPerSec, delta, base[i].p99, r->p99, slower ? "  REGRESSION" : "");
+    return slower;
+  }
+  fprintf(stderr, "%-26s %14s -> %14.1f ops/s (no baseline)\n", r->name, "", r->opsPerSec);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  FILE *out = stdout;
+  char json = 0, list = 0;
+  double scale = 1, threshold = 10;
+  const char *filter = 0, *baselinePath = 0;
+  Baseline base[nBenches * 2];
+  int nBase = 0, nSlower = 0, opt;
+
+  while ((opt = getopt(argc, argv, "f:o:s:r:b:t:l")) != -1) {
+    switch (opt) {
+      case 'f': json = !strcmp(optarg, "json"); break;
+      case 'o': out = fopen(optarg, "w"); if (!out) { perror(optarg); return 2; } break;
+      case 's': scale = atof(optarg); break;
+      case 'r': filter = optarg; break;
+      case 'b': baselinePath = optarg; break;
+      case 't': threshold = atof(optarg); break;
+      case 'l': list = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-f csv|json] [-o file] [-s scale] [-r filter] [-b baseline.csv] [-t threshold%%] [-l]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (list) {
+    for (int i = 0; i < nBenches; ++i) printf("%s\n", benches[i].name);
+    return 0;
+  }
+  struct rlimit lim; // socket scenarios need 2 fds per connection
+  if (!getrlimit(RLIMIT_NOFILE, &lim) && lim.rlim_cur < lim.rlim_max) {
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+  }
+  if (baselinePath && (nBase = readBaseline(baselinePath, base, nBenches * 2)) < 0) {
+    perror(baselinePath);
+    return 2;
+  }
+
+  if (json) fprintf(out, "[");
+  else printCsvHeader(out);
+  for (int i = 0, nRun = 0; i < nBenches; ++i) {
+    Bench *bench = benches + i;
+    if (filter && !strstr(bench->name, filter)) continue;
+    long long n = bench->n * scale;
+    if (n < 1) n = 1;
+
+    Samples lat = { 0, 0, 0 };
+    Result res = bench->func(bench->param, n, &lat);
+    qsort(lat.ns, lat.n, sizeof(*lat.ns), cmpSamples);
+    Report r = {
+      .name = bench->name, .ops = res.ops, .sec = res.nsec / 1e9,
+      .opsPerSec = res.nsec ? res.ops * 1e9 / res.nsec : 0,
+      .p50 = percentile(&lat, 0.5), .p90 = percentile(&lat, 0.9), .p99 = percentile(&lat, 0.99),
+      .max = lat.n ? lat.ns[lat.n - 1] : 0,
+    };
+    free(lat.ns);
+    printReport(out, &r, json, nRun++);
+    if (baselinePath) nSlower += compareBaseline(&r, base, nBase, threshold);
+  }
+  if (json) fprintf(out, "\n]\n");
+  if (out != stdout) fclose(out);
+  if (nSlower) fprintf(stderr, "%d scenario(s) slower than baseline by more than %g%%\n", nSlower, threshold);
+  return nSlower ? 1 : 0;
+}
@@ -20,8 +20,8 @@ pwa_EventLoop mainLoop;
 #define ReadFd_defaultChunkSize 256
 
 pwa_errors(ReadFile,
-  (success, open, read, poll),
-  ("success", "error: open", "error: read", "error: poll: not ready for reading")
+  (success, open),
+  ("success", "error: open")
 )
 
 typedef struct ReadFdChunk {
@@ -36,22 +36,13 @@ pwa_func((ReadFdChunk), ReadFd, (int fd; int chunkSize), (
   if (!_->chunkSize) _->chunkSize = ReadFd_defaultChunkSize;
   _->buf = (char *) malloc((_->chunkSize + 1) * sizeof(char));
   _->total = 0;
-  do {
-    do {
-      _->nRead = read(_->fd, _->buf, _->chunkSize);
-      if (!_->nRead) { pwa_return({0}); }
-      if (_->nRead == -1) {
-        if (errno == EAGAIN) break;
-        pwa_throw(pwa_error(ReadFile, read));
-      }
-      _->total += _->nRead;
-      _->buf[_->nRead] = 0;
-      pwa_yield(((ReadFdChunk) { _->buf, _->nRead }));
-    } while(_->nRead > 0);
-
-    pwa_await_fd_res(int res, _->fd, POLLIN);
-    if (!(res & POLLIN)) { pwa_throw(pwa_error(ReadFile, poll)); }
-  } while(1);
+  while (1) {
+    pwa_read(_->nRead, _->fd, _->buf, _->chunkSize);
+    if (!_->nRead) { pwa_return({0}); }
+    _->total += _->nRead;
+    _->buf[_->nRead] = 0;
+    pwa_yield(((ReadFdChunk) { _->buf, _->nRead }));
+  }
 } pwa_finally {
   if (_->buf) { free(_->buf); _->buf = 0; }
 } pwa_end_func
@@ -87,6 +78,31 @@ pwa_func((char), MemChars, (pwa_Iterator *iter; char **buf; int *size; char part
   .buf = &((_iter).value.buf), \
   .size = &((_iter).value.size)
 
+pwa_func((int), ExitSignals, (), (
+  int signum;
+  char force;
+)) {
+  while (1) {
+    pwa_await_signal(_->signum);
+    if (_->signum < 0) break;
+    printf("exit signal!\n");
+    if (_->force) { // jobs are hit at a safe point: no heap work in signal handler
+      pwa_loop_all_jobs_kill(mainLoop);
+      break;
+    }
+    _->force = 1;
+    pwa_loop_all_jobs_finish(mainLoop);
+  }
+} pwa_end_func
+
+// signals are watched while there's work: the last job to end finishes the watcher
+ExitSignals signals;
+int nWorking;
+
+void endWork(void) {
+  if (!--nWorking) pwa_loop_job_finish(mainLoop, signals);
+}
+
 pwa_func((int), BackgroundJob, (int n; float delaySec; char* spam), (
   int i;
 )) {
@@ -98,6 +114,7 @@ pwa_func((int), BackgroundJob, (int n; float delaySec; char* spam), (
   printf("job %s finishing...\n", _->spam);
   pwa_delay(1);
   printf("job %s finished!\n", _->spam);
+  endWork();
 } pwa_end_func
 
 pwa_func((int), Main, (), (
@@ -112,6 +129,7 @@ pwa_func((int), Main, (), (
 
   printf("hello ----\n");
 
+  nWorking += 2;
   _->job = pwa_iterate(BackgroundJob, (1, 10, "spam"));
   pwa_async_job(_->job);
 
@@ -133,36 +151,29 @@ pwa_func((int), Main, (), (
     printf("file error\n");
     printf("%s: %s\n", pwa_thrown_str, strerror(errno));
   }
+  else pwa_catch(pwa_Io) {
+    printf("%s: %s\n", pwa_thrown_str, strerror(errno));
+  }
   else pwa_catch_all {
     printf("unknown error\n");
   }
   printf("job main finishing...\n");
   pwa_delay(1);
   printf("job main finished!\n");
+  endWork();
 } pwa_end_func
 
-char force = 0;
-
-void onExit(int signum) {
-  printf("exit signal!\n");
-  if (force) {
-    pwa_loop_all_jobs_kill(mainLoop);
-    //pwa_loop_all_jobs_force_finish(mainLoop);
-  } else {
-    force = 1;
-    pwa_loop_all_jobs_finish(mainLoop);
-  }
-}
-
 int main(void) {
-  //pwa_on_signals((SIGINT, SIGHUP, SIGTERM), onExit);
-  pwa_on_exit_signals(onExit);
+  //pwa_watch_signals((SIGINT, SIGHUP, SIGTERM));
+  pwa_watch_exit_signals();
 
   pwa_iterate_var(main, Main, (0));
 
   pwa_loop_init(mainLoop);
+  signals = pwa_iterate(ExitSignals, ());
+  pwa_loop_async_job(mainLoop, signals);
   pwa_loop_async_job(mainLoop, main);
-  pwa_loop_job_detach(mainLoop, main);
+  pwa_loop_job_detach(mainLoop, main); // its background jobs run on; detached main is not counted
   // pwa_loop_async_job(mainLoop, main);
   pwa_loop_run(mainLoop);
   pwa_loop_free(mainLoop);
@@ -170,7 +181,10 @@ int main(void) {
   printf("loop 2\n");
 
   pwa_loop_init(mainLoop);
+  signals = pwa_iterate(ExitSignals, ());
+  pwa_loop_async_job(mainLoop, signals);
   pwa_reset(main);
+  nWorking = 1; // main ends its work in `finally`
   pwa_loop_async_job(mainLoop, main);
   pwa_loop_run(mainLoop);
   pwa_loop_free(mainLoop);
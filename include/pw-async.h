@@ -9,6 +9,7 @@
 #define __PW_ASYNC__
 
 #include <sys/types.h>
+#include <errno.h>
 #include <time.h>
 
 #include "pw-iter.h"
@@ -22,16 +23,57 @@
   #include <unistd.h>
 #endif
 
+#if defined __linux__ && ! defined PWA_NO_EPOLL
+  #include <sys/epoll.h>
+  #define PWA_EPOLL 1
+#endif
+
+#if defined __linux__ && ! defined PWA_NO_URING && defined __has_include
+  #if __has_include(<linux/io_uring.h>)
+    #define PWA_URING 1
+  #endif
+#endif
+
+// loop metrics (`pwa_EventLoop_getMetrics`): a few increments per turn; `PWA_NO_METRICS` compiles them out.
+// these flags don't change the layout of `pwa_EventLoop`, so code built with and without them may share loops
+#ifndef PWA_NO_METRICS
+  #define PWA_METRICS 1
+#endif
+
+// resume tracing (`pwa_EventLoop_setTrace`): off until a trace buffer is set; `PWA_NO_TRACE` compiles it out
+#ifndef PWA_NO_TRACE
+  #define PWA_TRACE 1
+  #include <stdio.h>
+#endif
+
+#if ! defined _WIN32 || defined __CYGWIN__
+  #include <sys/socket.h>
+#endif
+
 // pwa task -- awaiting event or issue a command to event loop
 #define pwa_Task_await_fd  0
 #define pwa_Task_delay     1
 #define pwa_Task_async_job 2
 #define pwa_Task_hit_job   3
 #define pwa_Task_hit_all_jobs  4
+#define pwa_Task_io        5
+#define pwa_Task_watch_fd  6
+#define pwa_Task_unwatch_fd 7
+#define pwa_Task_offload   8
+#define pwa_Task_wait      9
+#define pwa_Task_wake      10
+#define pwa_Task_join      11
+#define pwa_Task_await_fds 12
+#define pwa_Task_deadline  13
+#define pwa_Task_count     14 // number of task types
 
 // is set, when iterator is managed by event loop
 #define pwa_Task_attached_bit ((long long)1 << 41)
 #define pwa_Task_await_bit ((long long)1 << 42)
+// is set, while iterator is in run queue of event loop
+#define pwa_Task_queued_bit ((long long)1 << 43)
+// is set, while job woken from wait list with tokens holds one, and hasn't run yet
+#define pwa_Task_token_bit ((long long)1 << 39)
 #define pwa_Task_await_shift 48
 #define pwa_Task_await_mask ((1 << 8) - 1)
 #define pwa_Task_await_mask_shifted ((long long) pwa_Task_await_mask << pwa_Task_await_shift)
@@ -40,7 +82,7 @@
 #define pwa_Task_await_save_bits ( \
   ((long long) -_pwi_state_final_bit) - \
   ((long long) pwa_Task_await_mask << pwa_Task_await_shift) - \
-  pwa_Task_await_bit \
+  pwa_Task_await_bit - pwa_Task_token_bit \
 )
 
 // types
@@ -50,16 +92,85 @@ typedef pwi_Iterator pwa_Iterator;
 
 #define pwa_iterator pwi_iterator
 
+// fd of `pwa_await_fd`; `slot` is the position of its task (or in-flight op) in the loop while it's pending
+typedef struct pwa_Poll {
+  struct pollfd fds;
+  int slot;
+} pwa_Poll;
+
+// fds of `pwa_await_fds`: each one is a separate fd task in the loop, but the job is resumed once per turn
+// with `revents` of all ready ones; the rest are removed then
+typedef struct pwa_PollSet {
+  pwa_Poll *polls;
+  int n;
+  struct pwa_PollSet *nextFired; // in loop's list of sets resumed this turn
+} pwa_PollSet;
+
 typedef struct pwa_Task_AwaitFd {
   pwa_Iterator *iterator;
-  struct pollfd *fds;
+  pwa_Poll *poll;
+  int prev, next; // siblings awaiting the same fd (epoll backend)
 } pwa_Task_AwaitFd;
 
+// deadline of `pwa_delay`; `slot` is its position in the loop's timer heap while it's pending
+typedef struct pwa_Timer {
+  struct timespec until;
+  double sec; // if not negative, `until` is set by loop to `sec` after its cached clock
+  int slot;
+  char deadline; // heads `pwa_Deadline`
+  char failed; // no room to register it: job is resumed at once, with `errno` set to `ENOMEM`
+} pwa_Timer;
+
+// task bounded by timer (`pwa_await_fd_timeout`, `pwa_deadline_exec`): both are registered by one action,
+// and the job is parked on the deadline; on expiry the task is cancelled, and the job is resumed with `timedOut`
+typedef struct pwa_Deadline {
+  pwa_Timer timer;
+  void *desc; // of the task
+  int task; // -1 -- scope of the deadline is over
+  char once; // timer is dropped when the task is resumed
+  char timedOut;
+} pwa_Deadline;
+
 typedef struct pwa_Task_Delay {
   pwa_Iterator *iterator;
   struct timespec until;
+  pwa_Timer *timer;
 } pwa_Task_Delay;
 
+// completion-based I/O operations (`pwa_io_*`): submitted to io_uring by `pwa_Backend_uring`;
+// other backends try the syscall immediately and await fd readiness on `EAGAIN`
+#define pwa_Io_read    0
+#define pwa_Io_write   1
+#define pwa_Io_accept  2
+#define pwa_Io_connect 3
+#define pwa_Io_fsync   4
+
+// errors thrown by `pwa_read`, `pwa_write`, `pwa_recv`, `pwa_send`, `pwa_accept`, `pwa_connect`;
+// `errno` tells the cause
+struct pwa_Io_errorLayout { char read, write, recv, send, accept, connect; };
+extern char *pwa_Io_errorMessages[sizeof(struct pwa_Io_errorLayout)];
+
+typedef struct pwa_Task_Io {
+  char op, started;
+  int fd, flags;
+  void *buf; // data buffer or `struct sockaddr *` (accept, connect)
+  size_t len; // data buffer size or address size (connect)
+  off_t offset; // file position or -1 for current one (read, write)
+  socklen_t *addrLen; // accept
+  ssize_t res; // result or `-errno`
+  pwa_Poll poll;
+} pwa_Task_Io;
+
+// in-flight operation of completion backend; `id` of free slot links to next free one
+typedef struct pwa_Task_Op {
+  pwa_Iterator *iterator;
+  void *desc;
+  char task, polling;
+  unsigned gen;
+  int id;
+  char cancelling, how; // I/O op being cancelled, and hit of its job applied on completion
+} pwa_Task_Op;
+
 typedef struct pwa_Task_HitJob {
   pwa_Iterator *iterator;
   char how;
@@ -71,15 +182,174 @@ typedef struct pwa_Task_HitJob {
 #define pwa_Task_hit_force_finish 3
 #define pwa_Task_hit_force_next 4
 #define pwa_Task_hit_kill -1
+#define pwa_Task_post_job -2 // `pwa_EventLoop_post`: add job instead of hitting it
+#define pwa_Task_post_resume -3 // offload is done: resume the job parked on it
+
+// item of loop post queue: lock-free stack pushed by any thread, drained by loop once per turn
+typedef struct pwa_EventLoop_Post {
+  struct pwa_EventLoop_Post *next;
+  pwa_Task_HitJob hit;
+} pwa_EventLoop_Post;
+
+// entry of run queue: while queued, iterator's `tag` holds its position in the ring, and its own `tag` is kept here
+typedef struct pwa_EventLoop_Queued {
+  pwa_Iterator *iterator; // null, if detached while queued
+  void *tag;
+} pwa_EventLoop_Queued;
+
+// `pwa_offload`: sync iterator stepped by worker thread, while the awaiting job is parked.
+// `post` hands the job back to its loop, so completion needs no allocation
+typedef struct pwa_Offload {
+  pwa_EventLoop_Post post; // `next` links worker queue, then loop post queue
+  pwa_Iterator *iterator;
+  struct pwa_EventLoop *loop;
+  char exec; // step until done or awaiting, not just once
+} pwa_Offload;
+
+// FIFO of jobs parked by `pwa_wait` on an object (channel etc.); they are resumed in user space by
+// `pwa_wake` from another job of the same loop, with no syscalls
+typedef struct pwa_WaitList {
+  struct pwa_Wait *first, *last;
+  int *tokens; // if set, each woken job is handed one; if it's finished before it runs, the token is passed on
+} pwa_WaitList;
+
+// entry of wait list in locals of parked job; loop links its waiting jobs too, for `pwa_all_jobs_*` hits.
+// as `pwa_wake` descriptor, `n` is the number of jobs to resume (-1 -- all)
+typedef struct pwa_Wait {
+  pwa_WaitList *list; // null if not parked
+  struct pwa_Wait *prev, *next;
+  struct pwa_Wait *prevInLoop, *nextInLoop;
+  pwa_Iterator *iterator;
+  int n; // on resume: 1 if woken by `pwa_wake`, 0 if by hit
+  pwa_WaitList *woken; // list whose token the job holds
+} pwa_Wait;
+
+// event loop backends -- a kernel facility used to wait for fd readiness
+#define pwa_Backend_poll  0 // portable: `poll()` over array of all awaited fds on each turn
+#define pwa_Backend_epoll 1 // linux: fds stay registered in kernel; wakeup cost is O(ready)
+#define pwa_Backend_uring 2 // linux 5.11+: io_uring; I/O ops are batched and submitted once per turn
+
+#ifndef pwa_Backend_default
+  #define pwa_Backend_default pwa_Backend_poll
+#endif
+
+#ifndef pwa_Uring_entries
+  #define pwa_Uring_entries 256 // submission ring size
+#endif
+
+typedef struct pwa_EventLoop_FdWaiters {
+  int first; // first task awaiting the fd or -1
+  unsigned events; // events the fd is armed for in kernel
+  char armed;
+  char registered; // in epoll set, though one-shot registration is disarmed after firing
+  char watched; // registered persistently (edge-triggered) by `pwa_watch_fd`
+  unsigned pending; // watched: edge events, which no task awaited yet
+} pwa_EventLoop_FdWaiters;
+
+// run queue limits: 0 -- default, negative -- unlimited
+#ifndef pwa_EventLoop_defaultBudget
+  #define pwa_EventLoop_defaultBudget 512 // max resumes from run queue per loop turn
+#endif
+#ifndef pwa_EventLoop_defaultMaxResumes
+  #define pwa_EventLoop_defaultMaxResumes 64 // max consecutive `next()` calls of a job before it's requeued
+#endif
+
+// initial capacity of fd task and delay storage; grows twice when exhausted
+#ifndef pwa_EventLoop_defaultCapacity
+  #define pwa_EventLoop_defaultCapacity 64
+#endif
+
+#define pwa_EventLoop_nLateBuckets 20 // fixed, as it sizes `pwa_EventLoop`
+
+// counters are cumulative since loop init; times are measured by the loop clock, so they're as coarse as it is
+typedef struct pwa_EventLoop_Metrics {
+  unsigned long long nTurns;
+  unsigned long long nPolls; // backend waits (`poll`, `epoll_wait`, `io_uring_enter`)
+  unsigned long long nEmptyWakeups; // blocking waits, which returned with no ready fds
+  unsigned long long nResumes[pwa_Task_count]; // parked jobs resumed, by task type awaited
+  unsigned long long nLate[pwa_EventLoop_nLateBuckets]; // expired delays by lateness: `[i]` is < 2^i usec, last is the rest
+  unsigned long long waitNsec; // blocked in backend waits
+  unsigned long long runNsec; // out of waits: mostly resumed iterator code
+  int peakTasks, peakDelays; // fd tasks (or in-flight ops) and delays pending at once
+} pwa_EventLoop_Metrics;
+
+// one `next()` call of a job by loop
+typedef struct pwa_Trace_Record {
+  pwa_Iterator *iterator;
+  unsigned long long startNsec, endNsec; // loop clock
+  int label; // where it resumed: yield/await id, 0 -- start, -1 -- finalization
+  signed char task; // task type it parked on; -1 if it yielded or is done
+} pwa_Trace_Record;
+
+// ring buffer of the latest records, written by single loop without locks; `head` counts all records
+typedef struct pwa_Trace {
+  pwa_Trace_Record *records;
+  unsigned mask;
+  unsigned long long head;
+} pwa_Trace;
+
+typedef struct pwa_EventLoop_Config {
+  char backend;
+  int budget, maxResumes;
+  int nTasks, nDelays; // capacity hints: 0 -- default
+  char coarseClock; // cheaper loop clock of a few ms resolution (linux `CLOCK_MONOTONIC_COARSE`)
+  void *arena; // optional caller-owned memory for initial storage; unused if smaller than needed.
+  size_t arenaSize; // loop group splits it into equal parts, one per loop
+} pwa_EventLoop_Config;
+
+struct pwa_EventLoopGroup;
 
 typedef struct pwa_EventLoop {
   int nTasks, nTaskAlloc;
   int nDelays, nDelayAlloc;
   struct pollfd *fds;
   pwa_Task_AwaitFd *tasks;
-  pwa_Task_Delay *delays;
+  pwa_Task_Delay *delays; // binary min-heap by `until`
+  struct timespec now; // loop clock, cached once per turn
+  clockid_t clockId;
+  char *arena; // storage within it is not freed, but moved to heap when grown
+  size_t arenaSize;
+  char backend;
+  int backendFd;
+  int nFdWaiterAlloc, nEventAlloc;
+  pwa_EventLoop_FdWaiters *fdWaiters;
+  void *events;
+  int nOps, nOpAlloc, freeOp;
+  pwa_Task_Op *ops;
+  struct pwa_Uring *uring;
+  int budget, maxResumes;
+  unsigned queueHead; // position of the first one; positions of queued ones don't change when the ring grows
+  int nQueued, nQueueAlloc;
+  pwa_EventLoop_Queued *queue; // ring buffer of iterators ready to run
+  int wakeFd, wakeWriteFd; // wakes up loop waiting for events from other threads; -1 if not used
+  char wakeArmed;
+  struct pwa_EventLoopGroup *group;
+  int queueLock, hungry; // group: run queue is shared with thieves; loop waits for work to steal
+  pwa_EventLoop_Post *posts; // pushed by other threads
+  int nHolds; // loop keeps running without jobs, while other threads may post to it
+  pwa_Wait *waits; // jobs parked in wait lists; they don't keep loop running, as only jobs may wake them
+  pwa_PollSet *firedSets;
+  pwa_EventLoop_Metrics metrics; // not updated, if compiled out
+  struct timespec wokeAt; // end of last wait, start of run time
+  pwa_Trace *trace; // not read, if compiled out
 } pwa_EventLoop;
 
+typedef struct pwa_EventLoopGroup_Config {
+  int nLoops; // 0 -- one per online CPU
+  char pin; // pin each loop thread to its own CPU
+  pwa_EventLoop_Config loop;
+} pwa_EventLoopGroup_Config;
+
+// loops run by own threads; a loop with empty run queue steals queued iterators from others.
+// hits, waits and wakes act on the loop running the job, and are not synchronized with its siblings: they are
+// meant for jobs of that loop only. a queued iterator may be stolen meanwhile, and a hit on it is then dropped.
+// other loops of group are reached by `pwa_EventLoop_post`
+typedef struct pwa_EventLoopGroup {
+  int nLoops, nIdle, nextLoop;
+  char pin, stop;
+  pwa_EventLoop *loops;
+} pwa_EventLoopGroup;
+
 // helpers
 
 static inline void pwa_timespec_diff(struct timespec* dst, struct timespec* a, struct timespec* b) {
@@ -135,13 +405,27 @@ static inline struct timespec * pwa_timespec_monoClockIn(struct timespec *dst, d
 // macros
 
 #define pwa_func(type, name, args, vars) \
-  pwi_func(type, name, args, ( \
-    struct pollfd _pwa_fds; \
-    struct timespec _pwa_until; \
-    pwa_Task_HitJob _pwa_hit; \
+  pwa_func_decl(type, name, args, vars); \
+  pwa_func_body(name)
+
+// a job awaits one task at a time, so their descriptors share storage; a deadline bounds one of them
+#define pwa_func_decl(type, name, args, vars) \
+  pwi_func_decl(type, name, args, ( \
+    union { \
+      pwa_Poll _pwa_poll; \
+      pwa_PollSet _pwa_polls; \
+      pwa_Timer _pwa_timer; \
+      pwa_Task_HitJob _pwa_hit; \
+      pwa_Task_Io _pwa_io; \
+      pwa_Offload _pwa_offload; \
+      pwa_Wait _pwa_wait; \
+    }; \
+    pwa_Deadline _pwa_deadline; \
     _pw_multi vars \
   ))
 
+#define pwa_func_body pwi_func_body
+
 #define pwa_finally pwi_finally
 #define pwa_end_func pwi_end_func
 
@@ -166,6 +450,7 @@ static inline struct timespec * pwa_timespec_monoClockIn(struct timespec *dst, d
   _pwi_iter->tag = (void *) (_desc); \
   return _pwi_iter; case (_label): \
   _pwi_iter->state = ((unsigned)(int) _pwi_state_final) | (_pwi_state & pwa_Task_await_save_bits); \
+  _pwi_iter->tag = 0; /* shares storage with `done` */ \
 }
 #if defined __COUNTER__
   #define pwa_task_await_up(_task, _desc) pwa_task_await_up_(_task, _desc, __COUNTER__ + 1)
@@ -181,19 +466,169 @@ static inline struct timespec * pwa_timespec_monoClockIn(struct timespec *dst, d
 )
 
 #define pwa_await_fd(_fd, _events) { \
-  _->_pwa_fds.fd = _fd; \
-  _->_pwa_fds.events = _events; \
-  _->_pwa_fds.revents = 0; \
-  pwa_task_await(pwa_Task_await_fd, &(_->_pwa_fds)) \
+  _->_pwa_poll.fds.fd = _fd; \
+  _->_pwa_poll.fds.events = _events; \
+  _->_pwa_poll.fds.revents = 0; \
+  pwa_task_await(pwa_Task_await_fd, &(_->_pwa_poll)) \
+}
+
+// await any of `_n` fds in `pwa_Poll` array: `fds.fd` and `fds.events` are set by caller;
+// on resume `fds.revents` is set for each ready one, and 0 for others
+#define pwa_await_fds(_polls, _n) { \
+  _->_pwa_polls.polls = (_polls); \
+  _->_pwa_polls.n = (_n); \
+  pwa_task_await(pwa_Task_await_fds, &_->_pwa_polls) \
+}
+
+// keep fd registered in loop across `pwa_await_fd` on it; with epoll it's edge-triggered, so await only
+// after reading/writing until `EAGAIN`. unwatch before closing fd. `_->_pwa_poll.fds.revents` is `POLLNVAL` on error
+#define pwa_watch_fd(_fd, _events) { \
+  _->_pwa_poll.fds.fd = _fd; \
+  _->_pwa_poll.fds.events = _events; \
+  _->_pwa_poll.fds.revents = 0; \
+  pwa_task_await(pwa_Task_watch_fd, &(_->_pwa_poll)) \
+}
+
+#define pwa_unwatch_fd(_fd) { \
+  _->_pwa_poll.fds.fd = _fd; \
+  pwa_task_await(pwa_Task_unwatch_fd, &(_->_pwa_poll)) \
 }
 
 #define pwa_await_fd_res(_revents, _fd, _events) \
   pwa_await_fd(_fd, _events) \
-  _revents = _->_pwa_fds.revents
+  _revents = _->_pwa_poll.fds.revents
+
+// await task for at most `_sec`; `pwa_timed_out` is set, if it's cancelled by then
+#define pwa_task_await_timeout(_task, _desc, _sec) { \
+  _->_pwa_deadline = (pwa_Deadline) { \
+    .timer = { .sec = (double) (_sec), .slot = -1, .deadline = 1 }, .desc = (_desc), .task = (_task), .once = 1 \
+  }; \
+  if (_->_pwa_deadline.timer.sec < 0) _->_pwa_deadline.timer.sec = 0; \
+  pwa_task_await(pwa_Task_deadline, &_->_pwa_deadline) \
+}
+
+#define pwa_timed_out (_->_pwa_deadline.timedOut)
+
+// `_revents` is 0 on timeout
+#define pwa_await_fd_timeout(_revents, _fd, _events, _sec) \
+  _->_pwa_poll.fds.fd = _fd; \
+  _->_pwa_poll.fds.events = _events; \
+  _->_pwa_poll.fds.revents = 0; \
+  pwa_task_await_timeout(pwa_Task_await_fd, &_->_pwa_poll, _sec) \
+  _revents = _->_pwa_poll.fds.revents
+
+// wait for a signal watched by `pwa_watch_signals`; `_signum` (a local) is -1 if none are watched
+#define pwa_await_signal(_signum) \
+  while ((_signum = pwa_App_readSignal()) == 0) pwa_await_fd(pwa_App_signalFd, POLLIN)
 
+// counted from the loop clock, cached once per turn. `pwa_delay_failed` is set, if the timer couldn't be
+// registered, and the job is resumed at once (as fd await is with `POLLERR`)
+#define pwa_delay_failed (_->_pwa_timer.failed)
 #define pwa_delay(_sec) { \
-  if (pwa_timespec_monoClockIn(&_->_pwa_until, (double) (_sec))) \
-    pwa_task_await(pwa_Task_delay, &_->_pwa_until) \
+  _->_pwa_timer.sec = (double) (_sec); \
+  _->_pwa_timer.deadline = 0; /* storage is shared with other descriptors */ \
+  if (_->_pwa_timer.sec < 0) _->_pwa_timer.sec = 0; \
+  pwa_task_await(pwa_Task_delay, &_->_pwa_timer) \
+}
+
+// absolute deadline on the loop clock (`CLOCK_MONOTONIC`, or coarse one if configured)
+#define pwa_delay_until(_until) { \
+  _->_pwa_timer.until = (_until); \
+  _->_pwa_timer.sec = -1; \
+  _->_pwa_timer.deadline = 0; \
+  pwa_task_await(pwa_Task_delay, &_->_pwa_timer) \
+}
+
+// submit I/O operation; on resume `_->_pwa_io.res` holds the result or `-errno`
+#define pwa_io_(_io) { \
+  _->_pwa_io = (pwa_Task_Io) { _pw_multi _io, .res = -EAGAIN }; \
+  do { pwa_task_await(pwa_Task_io, &_->_pwa_io) } while (_->_pwa_io.res == -EAGAIN); \
+}
+
+#define pwa_io_read(_res, _fd, _buf, _len, _offset) \
+  pwa_io_((.op = pwa_Io_read, .fd = _fd, .buf = _buf, .len = _len, .offset = _offset)) \
+  _res = _->_pwa_io.res
+
+#define pwa_io_write(_res, _fd, _buf, _len, _offset) \
+  pwa_io_((.op = pwa_Io_write, .fd = _fd, .buf = (void *) (_buf), .len = _len, .offset = _offset)) \
+  _res = _->_pwa_io.res
+
+#define pwa_io_accept(_res, _fd, _addr, _addrLen, _flags) \
+  pwa_io_((.op = pwa_Io_accept, .fd = _fd, .buf = _addr, .addrLen = _addrLen, .flags = _flags)) \
+  _res = _->_pwa_io.res
+
+#define pwa_io_connect(_res, _fd, _addr, _addrLen) \
+  pwa_io_((.op = pwa_Io_connect, .fd = _fd, .buf = (void *) (_addr), .len = _addrLen)) \
+  _res = _->_pwa_io.res
+
+#define pwa_io_fsync(_res, _fd) \
+  pwa_io_((.op = pwa_Io_fsync, .fd = _fd)) \
+  _res = _->_pwa_io.res
+
+// try the call first and await fd only on `EAGAIN`; `_res` gets the byte count (0 at end of stream).
+// on failure `pwa_Io` error is thrown, `errno` is kept
+#define pwa_try_io_(_call, _err, _fd, _events) { \
+  while ((_->_pwa_io.res = (_call)) == -1) { \
+    if (errno == EINTR) continue; \
+    if (errno != EAGAIN && errno != EWOULDBLOCK) pwa_throw(pwa_error(pwa_Io, _err)); \
+    pwa_await_fd(_fd, _events) \
+    if (_->_pwa_poll.fds.revents & POLLNVAL) { errno = EBADF; pwa_throw(pwa_error(pwa_Io, _err)); } \
+  } \
+}
+
+#define pwa_read(_res, _fd, _buf, _len) \
+  pwa_try_io_(read(_fd, _buf, _len), read, _fd, POLLIN) \
+  _res = _->_pwa_io.res
+
+#define pwa_write(_res, _fd, _buf, _len) \
+  pwa_try_io_(write(_fd, _buf, _len), write, _fd, POLLOUT) \
+  _res = _->_pwa_io.res
+
+#define pwa_recv(_res, _fd, _buf, _len, _flags) \
+  pwa_try_io_(recv(_fd, _buf, _len, _flags), recv, _fd, POLLIN) \
+  _res = _->_pwa_io.res
+
+#define pwa_send(_res, _fd, _buf, _len, _flags) \
+  pwa_try_io_(send(_fd, _buf, _len, _flags), send, _fd, POLLOUT) \
+  _res = _->_pwa_io.res
+
+// run `next()` of sync iterator on worker thread, so that heavy step doesn't stall the loop.
+// loop must not touch the iterator meanwhile; hits to the parked job take no effect until it's resumed
+#define pwa_offload_(_iter, _exec) { \
+  _->_pwa_offload.iterator = (pwa_Iterator *) &(_iter); \
+  _->_pwa_offload.exec = _exec; \
+  pwa_task_await(pwa_Task_offload, &_->_pwa_offload) \
+}
+#define pwa_offload(_iter) pwa_offload_(_iter, 0)
+#define pwa_offload_exec(_iter) pwa_offload_(_iter, 1)
+
+// park in wait list until `pwa_wake` on it or a hit; the condition waited for is to be rechecked on resume
+#define pwa_wait(_list) { \
+  _->_pwa_wait.list = (_list); \
+  pwa_task_await(pwa_Task_wait, &_->_pwa_wait) \
+}
+
+// resume up to `_n` (-1 -- all) jobs in order of waiting; they run after the current job yields to loop
+#define pwa_wake(_list, _n) { \
+  if ((_list)->first) { \
+    _->_pwa_wait.list = (_list); \
+    _->_pwa_wait.n = (_n); \
+    pwa_task_await(pwa_Task_wake, &_->_pwa_wait) \
+  } \
+}
+
+// accepted socket is non-blocking
+#define pwa_accept(_res, _fd) \
+  pwa_try_io_(pwa_Socket_accept(_fd), accept, _fd, POLLIN) \
+  _res = _->_pwa_io.res
+
+// connect non-blocking socket; in-progress connection is awaited and its `SO_ERROR` is thrown as `errno`
+#define pwa_connect(_fd, _addr, _addrLen) { \
+  if (connect(_fd, (struct sockaddr *) (_addr), _addrLen)) { \
+    if (errno != EINPROGRESS && errno != EINTR) pwa_throw(pwa_error(pwa_Io, connect)); \
+    pwa_await_fd(_fd, POLLOUT) \
+    if ((errno = pwa_Socket_error(_fd))) pwa_throw(pwa_error(pwa_Io, connect)); \
+  } \
 }
 
 #define pwa_async_job(_iter) pwa_task_await(pwa_Task_async_job, &(_iter))
@@ -223,8 +658,8 @@ static inline struct timespec * pwa_timespec_monoClockIn(struct timespec *dst, d
 
 #define pwa_iter_await(_iter, _arg) { \
   while ((_iter).state & pwa_Task_await_bit) { \
-    pwa_task_await_up((_iter).state & pwa_Task_await_mask_shifted, (_iter).tag); \
-    (_iter).state &= ~pwa_Task_await_bit; \
+    pwa_task_await_up(pwa_Task_await_bit | ((_iter).state & pwa_Task_await_mask_shifted), (_iter).tag); \
+    (_iter).state &= pwa_Task_await_clear; /* task type bits would stall `next()` */ \
     pwi_next_(_iter, _arg); \
   } \
 }
@@ -279,6 +714,33 @@ static inline struct timespec * pwa_timespec_monoClockIn(struct timespec *dst, d
 }
 #define pwa_finish_exec(_iter) pwa_finish_exec_(_iter, 0)
 
+// run `_iter` to the end, but finish it, if it's not done in `_sec`; each of its awaits is parked under
+// the same timer, registered once. `pwa_timed_out` tells if it's finished by deadline
+#define pwa_deadline_exec(_iter, _sec) { \
+  _->_pwa_deadline = (pwa_Deadline) { .timer = { .sec = (double) (_sec), .slot = -1, .deadline = 1 } }; \
+  if (_->_pwa_deadline.timer.sec < 0) _->_pwa_deadline.timer.sec = 0; \
+  while (!((_iter).state & _pwi_state_done_bit)) { \
+    if (_->_pwa_deadline.timedOut) { \
+      (_iter).state &= pwa_Task_await_clear; \
+      (_iter).tag = 0; \
+      pwa_finish_exec(_iter) \
+      break; \
+    } \
+    if ((_iter).state & pwa_Task_await_bit) { \
+      _->_pwa_deadline.task = ((_iter).state >> pwa_Task_await_shift) & pwa_Task_await_mask; \
+      _->_pwa_deadline.desc = (_iter).tag; \
+      pwa_task_await(pwa_Task_deadline, &_->_pwa_deadline) \
+      if (_->_pwa_deadline.timedOut) continue; \
+      (_iter).state &= pwa_Task_await_clear; \
+    } \
+    pwi_next(_iter); \
+  } \
+  if (_->_pwa_deadline.timer.slot >= 0) { /* drop the timer */ \
+    _->_pwa_deadline.task = -1; \
+    pwa_task_await(pwa_Task_deadline, &_->_pwa_deadline) \
+  } \
+}
+
 #define pwa_yields_(_iter, _arg) { \
   while (1) { \
     pwa_next_(_iter, _arg); \
@@ -334,6 +796,260 @@ static inline struct timespec * pwa_timespec_monoClockIn(struct timespec *dst, d
 #define pwa_thrown pwi_thrown
 #define pwa_thrown_str pwi_thrown_str
 
+// channels: bounded FIFO of fixed-size items between jobs of one loop. sender waits while channel is full,
+// receiver -- while it's empty; each resumes the other through wait lists. not for jobs of loop group
+
+typedef struct pwa_Chan {
+  char *items; // ring buffer
+  int size, itemSize;
+  int head, n;
+  char closed;
+  pwa_WaitList senders, receivers;
+} pwa_Chan;
+
+int pwa_Chan_init(pwa_Chan *chan, int size, int itemSize); // `size` > 0
+void pwa_Chan_free(pwa_Chan *chan);
+int pwa_Chan_trySend(pwa_Chan *chan, const void *item); // 1 -- sent, 0 -- full, -1 -- closed
+int pwa_Chan_tryRecv(pwa_Chan *chan, void *item); // 1 -- received, 0 -- empty, -1 -- closed and drained
+
+// copy item from `_item` pointer; `_res` is 1, or 0 if channel is closed
+#define pwa_chan_send(_res, _chan, _item) { \
+  while (!(_res = pwa_Chan_trySend(_chan, _item))) pwa_wait(&(_chan)->senders) \
+  _res = _res > 0; \
+  pwa_wake(&(_chan)->receivers, 1) \
+}
+
+// copy item to `_item` pointer; `_res` is 1, or 0 if channel is closed and has no items left
+#define pwa_chan_recv(_res, _chan, _item) { \
+  while (!(_res = pwa_Chan_tryRecv(_chan, _item))) pwa_wait(&(_chan)->receivers) \
+  _res = _res > 0; \
+  pwa_wake(&(_chan)->senders, 1) \
+}
+
+// further sends fail; receivers get the items left
+#define pwa_chan_close(_chan) { \
+  (_chan)->closed = 1; \
+  pwa_wake(&(_chan)->senders, -1) \
+  pwa_wake(&(_chan)->receivers, -1) \
+}
+
+// synchronization of jobs of one loop: waiters are queued FIFO, and the releasing job hands over to the first
+// one directly, so a running job can't barge in meanwhile; if that one is finished before it runs, it's passed
+// on by loop. not for jobs of loop group
+
+// counting semaphore; mutex is one of count 1
+typedef struct pwa_Sem {
+  int count;
+  pwa_WaitList waiters;
+} pwa_Sem;
+
+typedef pwa_Sem pwa_Mutex;
+
+void pwa_Sem_init(pwa_Sem *sem, int count);
+int pwa_Sem_tryAcquire(pwa_Sem *sem); // 1 -- acquired, 0 -- would wait
+#define pwa_Mutex_init(_mutex) pwa_Sem_init(_mutex, 1)
+#define pwa_Mutex_tryLock pwa_Sem_tryAcquire
+
+// a job resumed by hit, and not finished by it, waits again
+#define pwa_sem_acquire(_sem) { \
+  if (!pwa_Sem_tryAcquire(_sem)) do pwa_wait(&(_sem)->waiters) while (!_->_pwa_wait.n); \
+}
+
+#define pwa_sem_release(_sem) { \
+  if ((_sem)->waiters.first) pwa_wake(&(_sem)->waiters, 1) /* the unit goes to the waiter */ \
+  else ++(_sem)->count; \
+}
+
+#define pwa_mutex_lock pwa_sem_acquire
+#define pwa_mutex_unlock pwa_sem_release
+
+// event: set one releases all its waiters and those coming until reset (manual reset),
+// or a single waiter, either waiting or the next one coming (auto reset)
+typedef struct pwa_Event {
+  int set;
+  char autoReset;
+  pwa_WaitList waiters;
+} pwa_Event;
+
+void pwa_Event_init(pwa_Event *event, char autoReset);
+
+#define pwa_event_wait(_event) { \
+  if ((_event)->set) { if ((_event)->autoReset) (_event)->set = 0; } \
+  else do pwa_wait(&(_event)->waiters) while (!_->_pwa_wait.n); \
+}
+
+#define pwa_event_set(_event) { \
+  if (!(_event)->autoReset) { (_event)->set = 1; pwa_wake(&(_event)->waiters, -1) } \
+  else if ((_event)->waiters.first) pwa_wake(&(_event)->waiters, 1) \
+  else (_event)->set = 1; \
+}
+
+#define pwa_event_reset(_event) ((_event)->set = 0)
+
+// joins: run array of iterators as concurrent jobs and wait until all of them are done (`pwa_all`),
+// the first one is done (`pwa_race`), or the first one succeeds (`pwa_any`). the rest are finished then,
+// and waited for, so the parent is resumed once, when no child runs. a child is managed by a `pwa_JoinTask` job
+
+#define pwa_Join_all  0
+#define pwa_Join_race 1
+#define pwa_Join_any  2
+
+struct pwa_Join_errorLayout { char alloc; };
+extern char *pwa_Join_errorMessages[sizeof(struct pwa_Join_errorLayout)];
+
+struct pwa_Join;
+
+pwa_func_decl((int), pwa_JoinTask, (pwa_Iterator *child; struct pwa_Join *join; int index), ());
+
+typedef struct pwa_Join {
+  pwa_JoinTask *tasks;
+  int n, nDone, nFailed;
+  int first; // all: first failed child; race: first done; any: first succeeded; -1 if none
+  char mode, cancelled;
+  char hitting, how; // parent was hit while waiting: it's hit (`how`) once no child runs in its locals
+  pwa_Iterator *iterator; // parent
+  pwa_WaitList waiters;
+  pwa_Wait wait;
+} pwa_Join;
+
+int pwa_Join_init(pwa_Join *join, char mode, void *iters, size_t iterSize, int n);
+void pwa_Join_free(pwa_Join *join);
+
+// children are neither to be started nor awaited otherwise; they are not finished until done or cancelled
+#define pwa_join_(_join, _mode, _iters, _n) { \
+  if (pwa_Join_init(&(_join), _mode, _iters, sizeof(*(_iters)), _n)) pwa_throw(pwa_error(pwa_Join, alloc)); \
+  if ((_join).n) pwa_task_await(pwa_Task_join, &(_join)) \
+  pwa_Join_free(&(_join)); \
+  if ((_join).n && !(_join).iterator) pwa_throw(pwa_error(pwa_Join, alloc)); /* no room to queue the children */ \
+}
+
+#define pwa_all(_join, _iters, _n) pwa_join_(_join, pwa_Join_all, _iters, _n)
+#define pwa_race(_join, _iters, _n) pwa_join_(_join, pwa_Join_race, _iters, _n)
+#define pwa_any(_join, _iters, _n) pwa_join_(_join, pwa_Join_any, _iters, _n)
+
+// file mapping: zero-copy reader, which yields slices of read-only mapping of file.
+// slices are not NUL-terminated; they stay valid until the iterator is finished
+
+#if ! defined _WIN32 || defined __CYGWIN__
+
+#ifndef pwa_MapFile_defaultChunkSize
+  #define pwa_MapFile_defaultChunkSize (1 << 20)
+#endif
+
+struct pwa_MapFile_errorLayout { char open, stat, map; };
+extern char *pwa_MapFile_errorMessages[sizeof(struct pwa_MapFile_errorLayout)];
+
+typedef struct pwa_Chunk {
+  char *buf;
+  int size;
+} pwa_Chunk;
+
+// file is opened by `name`, or `fd` is mapped if `name` is null
+pwa_func_decl((pwa_Chunk), pwa_MapFile, (char *name; int fd; size_t chunkSize), (
+  char ownsFd;
+  char *map;
+  size_t size, offset, n;
+));
+
+#endif
+
+// sockets: non-blocking, close-on-exec; TCP ones with `TCP_NODELAY`
+
+#if ! defined _WIN32 || defined __CYGWIN__
+
+#include <netinet/in.h>
+
+int pwa_Socket_setNonBlock(int fd);
+int pwa_Socket_setNoDelay(int fd);
+int pwa_Socket_error(int fd); // pending `SO_ERROR`; resets it
+int pwa_Socket_accept(int fd); // `accept4` where available
+int pwa_Socket_tcp(int family);
+// bind and listen; port 0 picks a free one, which is written back to `addr`
+int pwa_Socket_listen(struct sockaddr *addr, socklen_t *addrLen, int backlog);
+// IPv4 address; `ip` is dotted quad or null for any
+int pwa_Socket_addr4(struct sockaddr_in *dst, const char *ip, int port);
+
+// datagram batches: received with one `recvmmsg` per wakeup, sent with `sendmmsg`
+// (per-datagram calls where these are not available)
+
+#include <sys/uio.h>
+
+// kernel layout of `struct mmsghdr`, which libc declares only with `_GNU_SOURCE`
+typedef struct pwa_Datagram {
+  struct msghdr hdr;
+  unsigned len; // bytes received or sent
+} pwa_Datagram;
+
+// preallocated vector of `size` datagrams with buffers of `bufSize` bytes and address storage
+typedef struct pwa_Datagrams {
+  pwa_Datagram *msgs;
+  struct iovec *iovs;
+  struct sockaddr_storage *addrs;
+  char *bufs;
+  int size, bufSize;
+  int n, sent; // datagrams received, or added to send; sent of them
+} pwa_Datagrams;
+
+int pwa_Datagrams_init(pwa_Datagrams *batch, int size, int bufSize);
+void pwa_Datagrams_free(pwa_Datagrams *batch);
+#define pwa_Datagrams_buf(_batch, _i) ((_batch)->bufs + (size_t) (_i) * (_batch)->bufSize)
+// queue a copy of datagram to send; `to` may be null for connected socket. returns -1 if full or too long
+int pwa_Datagrams_add(pwa_Datagrams *batch, const void *data, size_t len, const struct sockaddr *to, socklen_t toLen);
+int pwa_Datagrams_recv(int fd, pwa_Datagrams *batch, int flags); // fills the batch from start; count or -1
+int pwa_Datagrams_send(int fd, pwa_Datagrams *batch); // sends unsent ones; count or -1
+
+// send all queued datagrams, awaiting fd on `EAGAIN`; the batch is emptied. `pwa_Io` send error is thrown
+#define pwa_send_datagrams(_fd, _batch) { \
+  while ((_batch)->sent < (_batch)->n) { \
+    if (pwa_Datagrams_send(_fd, _batch) != -1) continue; \
+    if (errno == EINTR) continue; \
+    if (errno != EAGAIN && errno != EWOULDBLOCK) pwa_throw(pwa_error(pwa_Io, send)); \
+    pwa_await_fd(_fd, POLLOUT) \
+    if (_->_pwa_poll.fds.revents & POLLNVAL) { errno = EBADF; pwa_throw(pwa_error(pwa_Io, send)); } \
+  } \
+  (_batch)->n = (_batch)->sent = 0; \
+}
+
+// yields the batch each time it's filled; drains socket until `EAGAIN` before awaiting it again.
+// datagrams of the batch are valid until next iteration
+pwa_func_decl((pwa_Datagrams *), pwa_RecvDatagrams, (int fd; pwa_Datagrams *batch; int flags), (
+  int res;
+));
+
+// yields accepted sockets; drains accept queue until `EAGAIN` before awaiting listening fd again.
+// sockets are non-blocking, and TCP ones get `TCP_NODELAY` if `noDelay`; consumer owns them
+pwa_func_decl((int), pwa_Accept, (int fd; char noDelay), (
+  int res;
+));
+
+#endif
+
+// file tailing: yields ranges appended to file, waiting for inotify events in between (linux).
+// follows the name: a truncated file is read from start, a rotated one is read to end, then new file is opened.
+// chunk buffer is reused by next iteration
+
+#ifdef __linux__
+
+#ifndef pwa_TailFile_defaultChunkSize
+  #define pwa_TailFile_defaultChunkSize (1 << 16)
+#endif
+
+struct pwa_TailFile_errorLayout { char init, open, read; };
+extern char *pwa_TailFile_errorMessages[sizeof(struct pwa_TailFile_errorLayout)];
+
+// starts from the end of file, unless `fromStart`
+pwa_func_decl((pwa_Chunk), pwa_TailFile, (char *name; size_t chunkSize; char fromStart), (
+  int ifd, fd;
+  char hasIfd, hasFd, watching;
+  char *buf;
+  off_t offset;
+  dev_t dev;
+  ino_t ino;
+  ssize_t n;
+));
+
+#endif
+
 // event loop lifecycle
 
 void pwa_EventLoop_init(pwa_EventLoop *loop);
@@ -343,6 +1059,14 @@ void pwa_EventLoop_init(pwa_EventLoop *loop);
   pwa_EventLoop id; \
   pwa_loop_init(id)
 
+// init with options (i.e.: `(.backend = pwa_Backend_epoll)`); falls back to `poll` if backend is unavailable
+int pwa_EventLoop_initConfig(pwa_EventLoop *loop, pwa_EventLoop_Config *config); // -1 -- no memory
+#define pwa_loop_init_config(id, config) \
+  pwa_EventLoop_initConfig(&(id), &(pwa_EventLoop_Config) { _pw_multi config })
+#define pwa_loop_init_config_var(id, config) \
+  pwa_EventLoop id; \
+  pwa_loop_init_config(id, config)
+
 void pwa_EventLoop_addAsync(pwa_EventLoop *loop, pwa_Iterator *iter, void* arg);
 #define pwa_loop_async_job(_loop, _iter) \
   pwa_EventLoop_addAsync(&(_loop), (pwa_Iterator *) &(_iter), 0)
@@ -358,6 +1082,7 @@ int pwa_EventLoop_hitJob(pwa_EventLoop *loop, pwa_Iterator *ignored, pwa_Task_Hi
 #define pwa_loop_job_force_next(_loop, _iter) pwa_loop_job_hit(_loop, _iter, pwa_Task_hit_force_next)
 #define pwa_loop_job_force_kill(_loop, _iter) pwa_loop_job_hit(_loop, _iter, pwa_Task_hit_kill)
 
+// returns -1 and hits none, if run queue can't grow to hold them all
 int pwa_EventLoop_hitAllJobs(pwa_EventLoop *loop, pwa_Iterator *ignored, ssize_t how);
 #define pwa_loop_all_jobs_hit(_loop, _how) \
   pwa_EventLoop_hitAllJobs(&(_loop), 0, _how)
@@ -369,14 +1094,107 @@ int pwa_EventLoop_hitAllJobs(pwa_EventLoop *loop, pwa_Iterator *ignored, ssize_t
 #define pwa_loop_all_jobs_force_next(_loop) pwa_loop_all_jobs_hit(_loop, pwa_Task_hit_forceNext)
 #define pwa_loop_all_jobs_kill(_loop) pwa_loop_all_jobs_hit(_loop, pwa_Task_hit_kill)
 
+// single loop turn; returns number of resumed jobs or negative error (-4: run queue can't grow, no event is taken)
+ssize_t pwa_EventLoop_turn(pwa_EventLoop *loop);
+
+// read the loop clock into cache and return it
+struct timespec * pwa_EventLoop_updateNow(pwa_EventLoop *loop);
+#define pwa_loop_now(_loop) (&(_loop).now)
+
+// run until no jobs are left; jobs still parked in wait lists then are finished
 ssize_t pwa_EventLoop_run(pwa_EventLoop *loop);
 #define pwa_loop_run(_loop) \
   pwa_EventLoop_run(&(_loop))
 
+// resume tracing: buffer keeps last `nRecords` (rounded up to power of 2) resumes; allocated once here
+int pwa_Trace_init(pwa_Trace *trace, int nRecords);
+void pwa_Trace_free(pwa_Trace *trace);
+
+// set (or unset with 0) the trace buffer of a loop; one buffer per loop. returns -1, if compiled out
+int pwa_EventLoop_setTrace(pwa_EventLoop *loop, pwa_Trace *trace);
+#define pwa_loop_trace(_loop, _trace) \
+  pwa_EventLoop_setTrace(&(_loop), &(_trace))
+
+#ifdef PWA_TRACE
+// write Chrome / Perfetto trace-event JSON; trace `i` is thread `i`. records being written meanwhile may be torn
+int pwa_Trace_export(FILE *out, pwa_Trace **traces, int n);
+#define pwa_trace_export(_out, _trace) \
+  pwa_Trace_export(_out, &(pwa_Trace *) { &(_trace) }, 1)
+#endif
+
+// copy of loop counters; zeroed, if compiled out. other threads may read it at any time, but not exactly consistent
+void pwa_EventLoop_getMetrics(pwa_EventLoop *loop, pwa_EventLoop_Metrics *dst);
+#define pwa_loop_metrics(_loop, _dst) \
+  pwa_EventLoop_getMetrics(&(_loop), &(_dst))
+
+// wake up the loop waiting for events; may be called from any thread
+int pwa_EventLoop_wake(pwa_EventLoop *loop);
+#define pwa_loop_wake(_loop) \
+  pwa_EventLoop_wake(&(_loop))
+
+// thread-safe: pass the job (`how` is `pwa_Task_post_job`) or hit (`pwa_Task_hit_*`) to the loop.
+// `post` is owned by the caller and kept until the loop takes it: then its `hit.iterator` is cleared
+int pwa_EventLoop_post(pwa_EventLoop *loop, pwa_EventLoop_Post *post, pwa_Iterator *iter, char how);
+#define pwa_loop_post_job(_loop, _post, _iter) \
+  pwa_EventLoop_post(&(_loop), &(_post), (pwa_Iterator *) &(_iter), pwa_Task_post_job)
+#define pwa_loop_post_hit(_loop, _post, _iter, _how) \
+  pwa_EventLoop_post(&(_loop), &(_post), (pwa_Iterator *) &(_iter), (_how))
+
+// thread-safe: keep the loop running without jobs until released, so that it may be posted to
+void pwa_EventLoop_hold(pwa_EventLoop *loop, int delta);
+#define pwa_loop_hold(_loop) pwa_EventLoop_hold(&(_loop), 1)
+#define pwa_loop_release(_loop) pwa_EventLoop_hold(&(_loop), -1)
+
+// posts not taken yet are dropped, with `hit.iterator` cleared as if taken; their memory is left to posters
 void pwa_EventLoop_free(pwa_EventLoop *loop);
 #define pwa_loop_free(id) \
   pwa_EventLoop_free(&(id))
 
+// event loop group lifecycle
+
+int pwa_EventLoopGroup_init(pwa_EventLoopGroup *group, pwa_EventLoopGroup_Config *config);
+#define pwa_loop_group_init(id, config) \
+  pwa_EventLoopGroup_init(&(id), &(pwa_EventLoopGroup_Config) { _pw_multi config })
+#define pwa_loop_group_init_var(id, config) \
+  pwa_EventLoopGroup id; \
+  pwa_loop_group_init(id, config)
+
+// queue the job to next loop of group (round-robin); before `pwa_loop_group_run` only
+void pwa_EventLoopGroup_addAsync(pwa_EventLoopGroup *group, pwa_Iterator *iter);
+#define pwa_loop_group_async_job(_group, _iter) \
+  pwa_EventLoopGroup_addAsync(&(_group), (pwa_Iterator *) &(_iter))
+
+// run loops in own threads (first one in calling thread) until all of them are out of jobs
+ssize_t pwa_EventLoopGroup_run(pwa_EventLoopGroup *group);
+#define pwa_loop_group_run(_group) \
+  pwa_EventLoopGroup_run(&(_group))
+
+void pwa_EventLoopGroup_free(pwa_EventLoopGroup *group);
+#define pwa_loop_group_free(id) \
+  pwa_EventLoopGroup_free(&(id))
+
+// worker pool of `pwa_offload`; started on first offload, unless started explicitly.
+// without threads (or wake fd of loop), offloaded steps run in place
+#ifndef pwa_App_defaultWorkers
+  #define pwa_App_defaultWorkers 0 // 0 -- one per online CPU
+#endif
+int pwa_App_startWorkers(int n);
+void pwa_App_stopWorkers(void); // queued steps are run before workers exit
+
+// signals delivered as loop events: watched signals are blocked and read from `pwa_App_signalFd`
+// (signalfd on linux; self-pipe elsewhere) by jobs with `pwa_await_signal`.
+// call before starting other threads, as they must inherit the blocked signal mask.
+extern int pwa_App_signalFd;
+int pwa_App_watchSignals(int n, int *signals);
+int pwa_App_watchExitSignals(void);
+int pwa_App_readSignal(void); // signal number; 0 if none pending
+#define pwa_watch_signals(_signals) { \
+  int signals[] = { _pw_multi _signals }; \
+  pwa_App_watchSignals(sizeof(signals) / sizeof(int), signals); \
+}
+#define pwa_watch_exit_signals() pwa_App_watchExitSignals()
+
+// plain signal handlers; these run in signal context, so must not call loop functions
 int pwa_App_handleSignals(int n, int* signals, void (*handler)(int));
 #define pwa_on_signals(_signals, _handler) { \
   int signals[] = { _pw_multi _signals }; \
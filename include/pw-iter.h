@@ -88,6 +88,11 @@ static pwi_Iterator * _pwi_stall_next(pwi_Iterator *_, void *arg) {
 //   - finally: (Statements) -- a source code of generator function finalization (used to wrap-up the context,
 //     useful when iterator is finished in the middle of execution.
 #define pwi_func(type, name, args, vars) \
+  pwi_func_decl(type, name, args, vars); \
+  pwi_func_body(name)
+
+// declare iterator type and its generator function (i.e. in a header); define it with `pwi_func_body(name)`
+#define pwi_func_decl(type, name, args, vars) \
   typedef _pw_multi type name ## _type; \
   typedef struct name ## _Locals { \
     _pw_multi args; \
@@ -101,11 +106,15 @@ static pwi_Iterator * _pwi_stall_next(pwi_Iterator *_, void *arg) {
     name ## _type value; \
     struct name ## _Locals locals; \
   } name; \
+  name* name ## _func(name *_pwi_iter, void *arg)
+
+#define pwi_func_body(name) \
   name* name ## _func(name *_pwi_iter, void *arg) { \
     register unsigned long long _pwi_state = _pwi_iter->state; \
     if (_pwi_state & _pwi_state_stall) return (name *) &_pwi_stall; \
     register name ## _Locals *_ = &_pwi_iter->locals; \
     while (1) { \
+      _pwi_exit: __attribute__((unused)); \
       switch ((int) _pwi_state) { \
         case _pwi_state_init: \
         _pwi_iter->state = (unsigned)(int) _pwi_state_final;
@@ -162,7 +171,7 @@ static pwi_Iterator * _pwi_stall_next(pwi_Iterator *_, void *arg) {
 #define pwi_fail_s(_iter) { pwi_fail(_iter); pwi_throws(_iter) }
 #define pwi_halt_s(_iter) { pwi_halt(_iter); pwi_throws(_iter) }
 
-#define pwi_exit() { _pwi_state = _pwi_iter->state; continue; }
+#define pwi_exit() { _pwi_state = _pwi_iter->state; goto _pwi_exit; } // jumps out of loops in function body too
 #define pwi_shut() break
 
 // A return-statement, which allows to execute the finalization prior to returning the final value
@@ -203,7 +212,7 @@ static pwi_Iterator * _pwi_stall_next(pwi_Iterator *_, void *arg) {
 #define pwi_halt(id) pwi_halt_(id, 0)
 
 #define pwi_finish_(id, value) ( \
-  (!((id).state & _pwi_state_final_bit)) && (*(int *)&(id).state = (int) _pwi_state_final), \
+  (void) ((!((id).state & _pwi_state_final_bit)) && (*(int *)&(id).state = (int) _pwi_state_final)), \
   (id).next(&(id), (void *)(value)) \
 )
 #define pwi_finish(id) pwi_finish_(id, 0)
@@ -1,127 +1,1341 @@
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "pw-async.h"
 
+#if ! defined _WIN32 || defined __CYGWIN__
+  #include <pthread.h>
+  #define PWA_THREADS 1
+#endif
+
+#ifdef __linux__
+  #include <stdint.h>
+  #include <limits.h>
+  #include <sys/inotify.h>
+  #include <sys/eventfd.h>
+  #include <sys/signalfd.h>
+  #include <sys/syscall.h>
+#endif
+
+#if ! defined _WIN32 || defined __CYGWIN__
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+#ifdef PWA_URING
+  #include <sys/syscall.h>
+  #include <linux/io_uring.h>
+#endif
+
+char *pwa_Io_errorMessages[sizeof(struct pwa_Io_errorLayout)] = {
+  "error: read", "error: write", "error: recv", "error: send", "error: accept", "error: connect"
+};
+
 // event loop implementation
 
-void pwa_EventLoop_init(pwa_EventLoop *loop) {
-  int nAlloc = loop->nTaskAlloc = loop->nDelayAlloc = getpagesize();
-  loop->fds = (struct pollfd *) malloc(nAlloc * sizeof(struct pollfd));
-  loop->tasks = (pwa_Task_AwaitFd *) malloc(nAlloc * sizeof(pwa_Task_AwaitFd));
-  loop->delays = (pwa_Task_Delay *) malloc(nAlloc * sizeof(pwa_Task_Delay));
+#ifdef PWA_METRICS
+  #define _pwa_EventLoop_count(_stmt) (_stmt)
+#else
+  #define _pwa_EventLoop_count(_stmt) ((void) 0)
+#endif
+
+#define _pwa_EventLoop_countResume(loop, iter) _pwa_EventLoop_count( \
+  ++(loop)->metrics.nResumes[((iter)->state >> pwa_Task_await_shift) & pwa_Task_await_mask] \
+)
+
+// storage: `fds` has a spare entry past `nTaskAlloc` for the wake fd
+
+#define _pwa_EventLoop_align(size) (((size) + 15) & ~(size_t) 15)
+
+static inline int _pwa_EventLoop_inArena(pwa_EventLoop *loop, void *ptr) {
+  return (char *) ptr >= loop->arena && (char *) ptr < loop->arena + loop->arenaSize;
+}
+
+// arena is never freed, so moving out of it is just a copy
+static void * _pwa_EventLoop_realloc(pwa_EventLoop *loop, void *ptr, size_t size, size_t oldSize) {
+  if (!_pwa_EventLoop_inArena(loop, ptr)) return realloc(ptr, size);
+  void *moved = malloc(size);
+  if (moved) memcpy(moved, ptr, oldSize);
+  return moved;
+}
+
+static inline void _pwa_EventLoop_release(pwa_EventLoop *loop, void *ptr) {
+  if (!_pwa_EventLoop_inArena(loop, ptr)) free(ptr);
+}
+
+static int _pwa_EventLoop_initStorage(pwa_EventLoop *loop, pwa_EventLoop_Config *config) {
+  int nTasks = config->nTasks > 0 ? config->nTasks : pwa_EventLoop_defaultCapacity;
+  int nDelays = config->nDelays > 0 ? config->nDelays : pwa_EventLoop_defaultCapacity;
+  size_t fdsSize = _pwa_EventLoop_align((nTasks + 1) * sizeof(struct pollfd));
+  size_t tasksSize = _pwa_EventLoop_align(nTasks * sizeof(pwa_Task_AwaitFd));
+  size_t delaysSize = nDelays * sizeof(pwa_Task_Delay);
+  loop->nTaskAlloc = nTasks;
+  loop->nDelayAlloc = nDelays;
   loop->nTasks = loop->nDelays = 0;
+  if (config->arena && config->arenaSize >= fdsSize + tasksSize + delaysSize) {
+    loop->arena = (char *) config->arena;
+    loop->arenaSize = config->arenaSize;
+    loop->fds = (struct pollfd *) loop->arena;
+    loop->tasks = (pwa_Task_AwaitFd *) (loop->arena + fdsSize);
+    loop->delays = (pwa_Task_Delay *) (loop->arena + fdsSize + tasksSize);
+    return 0;
+  }
+  loop->arena = 0;
+  loop->arenaSize = 0;
+  loop->fds = (struct pollfd *) malloc(fdsSize);
+  loop->tasks = (pwa_Task_AwaitFd *) malloc(tasksSize);
+  loop->delays = (pwa_Task_Delay *) malloc(delaysSize);
+  if (loop->fds && loop->tasks && loop->delays) return 0;
+  free(loop->fds);
+  free(loop->tasks);
+  free(loop->delays);
+  loop->fds = 0;
+  loop->tasks = 0;
+  loop->delays = 0;
+  loop->nTaskAlloc = loop->nDelayAlloc = 0;
+  return -1;
+}
+
+#ifdef PWA_URING
+static int _pwa_Uring_init(pwa_EventLoop *loop, unsigned entries);
+static void _pwa_Uring_free(pwa_EventLoop *loop);
+#endif
+
+static int _pwa_EventLoop_initWake(pwa_EventLoop *);
+
+// on failure, loop is only to be freed
+int pwa_EventLoop_initConfig(pwa_EventLoop *loop, pwa_EventLoop_Config *config) {
+  int res = _pwa_EventLoop_initStorage(loop, config);
+  loop->clockId = CLOCK_MONOTONIC;
+#ifdef CLOCK_MONOTONIC_COARSE
+  if (config->coarseClock) loop->clockId = CLOCK_MONOTONIC_COARSE;
+#endif
+  pwa_EventLoop_updateNow(loop);
+  loop->backend = pwa_Backend_poll;
+  loop->backendFd = -1;
+  loop->nFdWaiterAlloc = loop->nEventAlloc = 0;
+  loop->fdWaiters = 0;
+  loop->events = 0;
+  loop->budget = config->budget ? config->budget : pwa_EventLoop_defaultBudget;
+  loop->maxResumes = config->maxResumes ? config->maxResumes : pwa_EventLoop_defaultMaxResumes;
+  loop->queueHead = loop->nQueued = loop->nQueueAlloc = 0;
+  loop->queue = 0;
+  loop->wakeFd = loop->wakeWriteFd = -1;
+  loop->wakeArmed = 0;
+  loop->group = 0;
+  loop->queueLock = loop->hungry = 0;
+  loop->posts = 0;
+  loop->nHolds = 0;
+  loop->waits = 0;
+  loop->firedSets = 0;
+  memset(&loop->metrics, 0, sizeof(loop->metrics));
+  loop->wokeAt = loop->now;
+  loop->trace = 0;
+  loop->nOps = loop->nOpAlloc = 0;
+  loop->freeOp = -1;
+  loop->ops = 0;
+  loop->uring = 0;
+  char backend = config->backend;
+#ifdef PWA_URING
+  if (backend == pwa_Backend_uring) {
+    if (!_pwa_Uring_init(loop, pwa_Uring_entries)) loop->backend = pwa_Backend_uring;
+    else backend = pwa_Backend_epoll;
+  }
+#endif
+#ifdef PWA_EPOLL
+  if (backend == pwa_Backend_epoll) {
+    loop->backendFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->backendFd != -1) loop->backend = pwa_Backend_epoll;
+  }
+#endif
+  _pwa_EventLoop_initWake(loop); // on failure, loop still works; `pwa_EventLoop_post` fails
+  return res;
+}
+
+void pwa_EventLoop_init(pwa_EventLoop *loop) {
+  pwa_EventLoop_initConfig(loop, &(pwa_EventLoop_Config) { .backend = pwa_Backend_default });
 }
 
 void pwa_EventLoop_free(pwa_EventLoop *loop) {
-  free(loop->delays);
-  free(loop->tasks);
-  free(loop->fds);
+#ifdef PWA_URING
+  if (loop->uring) _pwa_Uring_free(loop);
+#endif
+  if (loop->backendFd != -1) { close(loop->backendFd); loop->backendFd = -1; }
+  if (loop->wakeWriteFd != -1 && loop->wakeWriteFd != loop->wakeFd) close(loop->wakeWriteFd);
+  if (loop->wakeFd != -1) { close(loop->wakeFd); loop->wakeFd = loop->wakeWriteFd = -1; }
+  // posts are owned by posters (or by offload): they are only unlinked and released for reuse
+  pwa_EventLoop_Post *post = __atomic_exchange_n(&loop->posts, 0, __ATOMIC_ACQUIRE), *next;
+  for (; post; post = next) {
+    next = post->next;
+    post->next = 0;
+    if (post->hit.how != pwa_Task_post_resume) __atomic_store_n(&post->hit.iterator, 0, __ATOMIC_RELEASE);
+  }
+  free(loop->ops);
+  free(loop->queue);
+  free(loop->events);
+  free(loop->fdWaiters);
+  _pwa_EventLoop_release(loop, loop->delays);
+  _pwa_EventLoop_release(loop, loop->tasks);
+  _pwa_EventLoop_release(loop, loop->fds);
 }
 
-int pwa_EventLoop_addTask(pwa_EventLoop *loop, pwa_Iterator *iterator, struct pollfd *fds) {
+static void _pwa_EventLoop_enqueueAsync(pwa_EventLoop *, pwa_Iterator *);
+static int _pwa_EventLoop_reserveQueue(pwa_EventLoop *, int);
+static inline void _pwa_EventLoop_lockQueue(pwa_EventLoop *);
+static inline void _pwa_EventLoop_unlockQueue(pwa_EventLoop *);
+static pwa_EventLoop_Queued * _pwa_EventLoop_queued(pwa_EventLoop *, pwa_Iterator *);
+
+// wake fd: eventfd (or pipe) watched by backend along with tasks, but not counted as a job
+
+static int _pwa_EventLoop_initWake(pwa_EventLoop *loop) {
+  if (loop->wakeFd != -1) return 0;
+#ifdef __linux__
+  loop->wakeFd = loop->wakeWriteFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (loop->wakeFd == -1) return -1;
+#else
+  int fds[2];
+  if (pipe(fds)) return -1;
+  for (int i = 0; i < 2; ++i) fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  loop->wakeFd = fds[0];
+  loop->wakeWriteFd = fds[1];
+#endif
+#ifdef PWA_EPOLL
+  if (loop->backend == pwa_Backend_epoll) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = loop->wakeFd };
+    if (epoll_ctl(loop->backendFd, EPOLL_CTL_ADD, loop->wakeFd, &ev)) return -1;
+  }
+#endif
+  return 0;
+}
+
+int pwa_EventLoop_wake(pwa_EventLoop *loop) {
+  unsigned long long one = 1;
+  if (loop->wakeWriteFd == -1) return -1;
+  return write(loop->wakeWriteFd, &one, sizeof(one)) == -1 && errno != EAGAIN ? -1 : 0;
+}
+
+static void _pwa_EventLoop_drainWake(pwa_EventLoop *loop) {
+  unsigned long long n;
+  while (read(loop->wakeFd, &n, sizeof(n)) > 0 && loop->wakeFd != loop->wakeWriteFd);
+}
+
+static int _pwa_EventLoop_pushPost(pwa_EventLoop *loop, pwa_EventLoop_Post *post) {
+  pwa_EventLoop_Post *head = __atomic_load_n(&loop->posts, __ATOMIC_RELAXED);
+  do post->next = head;
+  while (!__atomic_compare_exchange_n(&loop->posts, &head, post, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  // only first post of a batch wakes the loop up; the rest are drained along with it.
+  // `post` may be taken by loop right away, so it's not read after push
+  return head ? 0 : pwa_EventLoop_wake(loop);
+}
+
+int pwa_EventLoop_post(pwa_EventLoop *loop, pwa_EventLoop_Post *post, pwa_Iterator *iter, char how) {
+  if (loop->wakeFd == -1) return -1;
+  post->hit = (pwa_Task_HitJob) { iter, how };
+  return _pwa_EventLoop_pushPost(loop, post);
+}
+
+void pwa_EventLoop_hold(pwa_EventLoop *loop, int delta) {
+  if (!__atomic_add_fetch(&loop->nHolds, delta, __ATOMIC_ACQ_REL)) pwa_EventLoop_wake(loop);
+}
+
+static int _pwa_EventLoop_dropTimer(pwa_EventLoop *, pwa_Timer *);
+int pwa_EventLoop_hitIter(pwa_EventLoop *, pwa_Iterator *, char);
+
+// resume job of finished task. a job awaiting several fds is resumed by the first one, and the rest of its
+// set is removed after all events of the turn are dispatched, so that the tasks are not moved meanwhile.
+// timers of deadlines around the task are dropped, unless they bound a whole `pwa_deadline_exec`
+static inline void _pwa_EventLoop_resume(pwa_EventLoop *loop, pwa_Iterator *iter) {
+  if (!(iter->state & pwa_Task_await_bit)) return; // another fd of its set fired already
+  int task = (iter->state >> pwa_Task_await_shift) & pwa_Task_await_mask;
+  void *desc = iter->tag;
+  for (pwa_Deadline *d; task == pwa_Task_deadline; task = d->task, desc = d->desc) {
+    d = (pwa_Deadline *) desc;
+    if (d->once) _pwa_EventLoop_dropTimer(loop, &d->timer);
+  }
+  if (task == pwa_Task_await_fds) {
+    pwa_PollSet *set = (pwa_PollSet *) desc;
+    set->nextFired = loop->firedSets;
+    loop->firedSets = set;
+  }
+  _pwa_EventLoop_countResume(loop, iter);
+  iter->state &= pwa_Task_await_clear;
+  _pwa_EventLoop_enqueueAsync(loop, iter);
+}
+
+// epoll backend: each fd is registered once with `EPOLLONESHOT` and re-armed only when the set of awaited
+// events changes or after it fires; tasks awaiting the same fd are chained in a list by index
+
+#ifdef PWA_EPOLL
+
+static pwa_EventLoop_FdWaiters * _pwa_EventLoop_fdWaiters(pwa_EventLoop *loop, int fd) {
+  if (fd >= loop->nFdWaiterAlloc) {
+    int n = loop->nFdWaiterAlloc, nAlloc = n ? n : 64;
+    while (nAlloc <= fd) nAlloc <<= 1;
+    pwa_EventLoop_FdWaiters *w = (pwa_EventLoop_FdWaiters *) realloc(loop->fdWaiters, nAlloc * sizeof(*w));
+    if (!w) return 0;
+    for (int i = n; i < nAlloc; ++i) w[i] = (pwa_EventLoop_FdWaiters) { -1, 0, 0 };
+    loop->fdWaiters = w;
+    loop->nFdWaiterAlloc = nAlloc;
+  }
+  return loop->fdWaiters + fd;
+}
+
+static int _pwa_EventLoop_epollArm(pwa_EventLoop *loop, int fd, pwa_EventLoop_FdWaiters *w, unsigned events) {
+  struct epoll_event ev = { .events = events | (w->watched ? EPOLLET : EPOLLONESHOT), .data.fd = fd };
+  int op = w->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  int err = epoll_ctl(loop->backendFd, op, fd, &ev);
+  // closing fd removes it from epoll set, and its number may be reused meanwhile
+  if (err && errno == ENOENT) err = epoll_ctl(loop->backendFd, op = EPOLL_CTL_ADD, fd, &ev);
+  else if (err && errno == EEXIST) err = epoll_ctl(loop->backendFd, op = EPOLL_CTL_MOD, fd, &ev);
+  if (err) return -1;
+  w->events = events;
+  w->armed = w->registered = 1;
+  return 0;
+}
+
+static void _pwa_EventLoop_unlinkTask(pwa_EventLoop *loop, int taskId) {
+  pwa_Task_AwaitFd *task = loop->tasks + taskId;
+  pwa_EventLoop_FdWaiters *w = loop->fdWaiters + loop->fds[taskId].fd;
+  if (task->prev >= 0) loop->tasks[task->prev].next = task->next;
+  else w->first = task->next;
+  if (task->next >= 0) loop->tasks[task->next].prev = task->prev;
+  // last waiter is gone (hit or timed out): fd may be closed and its number reused before next await,
+  // so that one re-arms rather than trusting a registration kernel may have dropped
+  if (w->first < 0 && !w->watched) { w->events = 0; w->armed = 0; }
+}
+
+static void _pwa_EventLoop_relinkTask(pwa_EventLoop *loop, int taskId) {
+  pwa_Task_AwaitFd *task = loop->tasks + taskId;
+  if (task->prev >= 0) loop->tasks[task->prev].next = taskId;
+  else loop->fdWaiters[loop->fds[taskId].fd].first = taskId;
+  if (task->next >= 0) loop->tasks[task->next].prev = taskId;
+}
+
+#endif
+
+// io_uring backend: operations (including fd awaits as `IORING_OP_POLL_ADD`) are queued in submission ring
+// and submitted together with waiting for completions -- one `io_uring_enter()` per loop turn.
+// `user_data` of each entry refers to a slot in `loop->ops` tagged with its generation, so completions of
+// cancelled operations are recognized and dropped.
+
+#ifdef PWA_URING
+
+#define pwa_Uring_ignore (~(unsigned long long) 0)
+#define pwa_Uring_wake (~(unsigned long long) 1)
+
+
+typedef struct pwa_Uring {
+  unsigned *sqHead, *sqTail, sqMask, sqEntries;
+  unsigned *cqHead, *cqTail, cqMask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sqRing, *cqRing;
+  size_t sqRingSize, cqRingSize;
+} pwa_Uring;
+
+static int _pwa_Uring_init(pwa_EventLoop *loop, unsigned entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd == -1) return -1;
+  if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    close(fd);
+    return -1;
+  }
+
+  pwa_Uring *uring = (pwa_Uring *) malloc(sizeof(pwa_Uring));
+  if (!uring) { close(fd); return -1; }
+  size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  uring->sqRingSize = uring->cqRingSize = sqSize > cqSize ? sqSize : cqSize;
+  uring->sqRing = uring->cqRing = mmap(0, uring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+    fd, IORING_OFF_SQ_RING);
+  size_t sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  uring->sqes = (struct io_uring_sqe *) mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+    fd, IORING_OFF_SQES);
+  if (uring->sqRing == MAP_FAILED || uring->sqes == MAP_FAILED) { // either may fail alone: the other is unmapped
+    if (uring->sqRing != MAP_FAILED) munmap(uring->sqRing, uring->sqRingSize);
+    if (uring->sqes != MAP_FAILED) munmap(uring->sqes, sqesSize);
+    free(uring);
+    close(fd);
+    return -1;
+  }
+
+  char *sq = (char *) uring->sqRing, *cq = (char *) uring->cqRing;
+  uring->sqHead = (unsigned *) (sq + params.sq_off.head);
+  uring->sqTail = (unsigned *) (sq + params.sq_off.tail);
+  uring->sqMask = *(unsigned *) (sq + params.sq_off.ring_mask);
+  uring->sqEntries = params.sq_entries;
+  unsigned *array = (unsigned *) (sq + params.sq_off.array);
+  for (unsigned i = 0; i < params.sq_entries; ++i) array[i] = i;
+  uring->cqHead = (unsigned *) (cq + params.cq_off.head);
+  uring->cqTail = (unsigned *) (cq + params.cq_off.tail);
+  uring->cqMask = *(unsigned *) (cq + params.cq_off.ring_mask);
+  uring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+  loop->uring = uring;
+  loop->backendFd = fd;
+  return 0;
+}
+
+static void _pwa_Uring_free(pwa_EventLoop *loop) {
+  pwa_Uring *uring = loop->uring;
+  munmap(uring->sqes, uring->sqEntries * sizeof(struct io_uring_sqe));
+  munmap(uring->sqRing, uring->sqRingSize);
+  free(uring);
+  loop->uring = 0;
+}
+
+static int _pwa_Uring_enter(pwa_EventLoop *loop, unsigned minComplete, struct timespec *span) {
+  pwa_Uring *uring = loop->uring;
+  unsigned toSubmit = *uring->sqTail - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE);
+  unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg = { 0 };
+  if (span) {
+    ts.tv_sec = span->tv_sec;
+    ts.tv_nsec = span->tv_nsec;
+    arg.ts = (unsigned long long) &ts;
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+  if (!toSubmit && !minComplete) return 0;
+  int res = syscall(__NR_io_uring_enter, loop->backendFd, toSubmit, minComplete, flags,
+    span ? (void *) &arg : 0, span ? sizeof(arg) : 0);
+  if (res == -1 && errno != EINTR && errno != ETIME && errno != EBUSY) return -1;
+  return 0;
+}
+
+static struct io_uring_sqe * _pwa_Uring_getSqe(pwa_EventLoop *loop) {
+  pwa_Uring *uring = loop->uring;
+  unsigned tail = *uring->sqTail;
+  if (tail - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE) == uring->sqEntries) {
+    if (_pwa_Uring_enter(loop, 0, 0)) return 0; // submission ring is full -- flush it
+    if (tail - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE) == uring->sqEntries) return 0;
+  }
+  struct io_uring_sqe *sqe = uring->sqes + (tail & uring->sqMask);
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+static void _pwa_Uring_pushSqe(pwa_EventLoop *loop) {
+  pwa_Uring *uring = loop->uring;
+  __atomic_store_n(uring->sqTail, *uring->sqTail + 1, __ATOMIC_RELEASE);
+}
+
+static int _pwa_EventLoop_allocOp(pwa_EventLoop *loop, pwa_Iterator *iterator, void *desc, char task) {
+  int opId = loop->freeOp;
+  if (opId < 0) {
+    int n = loop->nOpAlloc, nAlloc = n ? n << 1 : 64;
+    pwa_Task_Op *ops = (pwa_Task_Op *) realloc(loop->ops, nAlloc * sizeof(pwa_Task_Op));
+    if (!ops) return -1;
+    for (int i = n; i < nAlloc; ++i) ops[i] = (pwa_Task_Op) { 0, 0, -1, 0, 0, i + 1 < nAlloc ? i + 1 : -1 };
+    loop->ops = ops;
+    loop->nOpAlloc = nAlloc;
+    opId = n;
+  }
+  pwa_Task_Op *op = loop->ops + opId;
+  loop->freeOp = op->id;
+  op->iterator = iterator;
+  op->desc = desc;
+  op->task = task;
+  op->polling = 0;
+  op->cancelling = 0;
+  op->id = opId;
+  ++loop->nOps;
+  return opId;
+}
+
+static void _pwa_EventLoop_freeOp(pwa_EventLoop *loop, int opId) {
+  pwa_Task_Op *op = loop->ops + opId;
+  op->iterator = 0;
+  op->task = -1;
+  ++op->gen;
+  op->id = loop->freeOp;
+  loop->freeOp = opId;
+  --loop->nOps;
+}
+
+static int _pwa_Uring_prepPoll(pwa_EventLoop *loop, int opId, int fd, unsigned events) {
+  struct io_uring_sqe *sqe = _pwa_Uring_getSqe(loop);
+  if (!sqe) return -1;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  sqe->user_data = ((unsigned long long) loop->ops[opId].gen << 32) | (unsigned) opId;
+  _pwa_Uring_pushSqe(loop);
+  return 0;
+}
+
+static int _pwa_Uring_prepIo(pwa_EventLoop *loop, int opId, pwa_Task_Io *io) {
+  struct io_uring_sqe *sqe = _pwa_Uring_getSqe(loop);
+  if (!sqe) return -1;
+  sqe->fd = io->fd;
+  switch (io->op) {
+    case pwa_Io_read: case pwa_Io_write:
+      sqe->opcode = io->op == pwa_Io_read ? IORING_OP_READ : IORING_OP_WRITE;
+      sqe->addr = (unsigned long long) io->buf;
+      sqe->len = io->len;
+      sqe->off = io->offset;
+      break;
+    case pwa_Io_accept:
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->addr = (unsigned long long) io->buf;
+      sqe->addr2 = (unsigned long long) io->addrLen;
+      sqe->accept_flags = io->flags;
+      break;
+    case pwa_Io_connect:
+      sqe->opcode = IORING_OP_CONNECT;
+      sqe->addr = (unsigned long long) io->buf;
+      sqe->off = io->len;
+      break;
+    case pwa_Io_fsync: sqe->opcode = IORING_OP_FSYNC; break;
+  }
+  sqe->user_data = ((unsigned long long) loop->ops[opId].gen << 32) | (unsigned) opId;
+  _pwa_Uring_pushSqe(loop);
+  return 0;
+}
+
+static void _pwa_Uring_prepCancel(pwa_EventLoop *loop, int opId) {
+  struct io_uring_sqe *sqe = _pwa_Uring_getSqe(loop);
+  if (sqe) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = ((unsigned long long) loop->ops[opId].gen << 32) | (unsigned) opId;
+    sqe->user_data = pwa_Uring_ignore;
+    _pwa_Uring_pushSqe(loop);
+  }
+}
+
+static void _pwa_Uring_cancelOp(pwa_EventLoop *loop, int opId) {
+  _pwa_Uring_prepCancel(loop, opId);
+  _pwa_EventLoop_freeOp(loop, opId);
+}
+
+// kernel may write to buffers of I/O op in job's locals until it completes, so the op is kept, and its job is
+// hit (`how`), or resumed (`pwa_Task_post_resume`), only then; a later hit replaces the pending one
+static void _pwa_Uring_cancelIo(pwa_EventLoop *loop, int opId, char how) {
+  pwa_Task_Op *op = loop->ops + opId;
+  op->how = how;
+  if (op->cancelling) return;
+  op->cancelling = 1;
+  _pwa_Uring_prepCancel(loop, opId);
+}
+
+static int _pwa_Uring_addTask(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Poll *poll) {
+  int opId = _pwa_EventLoop_allocOp(loop, iterator, poll, pwa_Task_await_fd);
+  if (opId >= 0 && !_pwa_Uring_prepPoll(loop, opId, poll->fds.fd, (unsigned short) poll->fds.events)) {
+    poll->slot = opId;
+    return 1;
+  }
+  if (opId >= 0) _pwa_EventLoop_freeOp(loop, opId);
+  poll->fds.revents = POLLERR;
+  return 0;
+}
+
+static int _pwa_Uring_addIo(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Task_Io *io) {
+  int opId = _pwa_EventLoop_allocOp(loop, iterator, io, pwa_Task_io);
+  if (opId >= 0 && !_pwa_Uring_prepIo(loop, opId, io)) {
+    io->poll.slot = opId;
+    return 1;
+  }
+  if (opId >= 0) _pwa_EventLoop_freeOp(loop, opId);
+  io->res = -ENOMEM;
+  return 0;
+}
+
+static int _pwa_Uring_execTasks(pwa_EventLoop *loop) {
+  pwa_Uring *uring = loop->uring;
+  unsigned head = *uring->cqHead, tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+  int nRan = 0;
+
+  for (; head != tail; ++head) {
+    struct io_uring_cqe *cqe = uring->cqes + (head & uring->cqMask);
+    unsigned long long data = cqe->user_data;
+    int res = cqe->res;
+    __atomic_store_n(uring->cqHead, head + 1, __ATOMIC_RELEASE);
+    if (data == pwa_Uring_ignore) continue;
+    if (data == pwa_Uring_wake) { _pwa_EventLoop_drainWake(loop); loop->wakeArmed = 0; continue; }
+
+    int opId = (int) (unsigned) data;
+    if (opId >= loop->nOpAlloc) continue;
+    pwa_Task_Op *op = loop->ops + opId;
+    if (op->gen != (unsigned) (data >> 32) || !op->iterator) continue; // cancelled
+
+    pwa_Iterator *iter = op->iterator;
+    if (op->cancelling) { // result or `-ECANCELED`; the buffers are not used by kernel anymore
+      char how = op->how;
+      ((pwa_Task_Io *) op->desc)->res = res;
+      _pwa_EventLoop_freeOp(loop, opId);
+      ++nRan;
+      if (how == pwa_Task_post_resume) _pwa_EventLoop_resume(loop, iter);
+      else pwa_EventLoop_hitIter(loop, iter, how);
+      continue;
+    }
+    if (op->task == pwa_Task_io) {
+      pwa_Task_Io *io = (pwa_Task_Io *) op->desc;
+      if (op->polling) { // fd became ready -- retry the operation
+        op->polling = 0;
+        if (res >= 0 && !_pwa_Uring_prepIo(loop, opId, io)) continue;
+      } else if (res == -EAGAIN && io->op != pwa_Io_fsync) { // non-blocking fd is not ready -- poll it first
+        op->polling = 1;
+        unsigned events = io->op == pwa_Io_read || io->op == pwa_Io_accept ? POLLIN : POLLOUT;
+        if (!_pwa_Uring_prepPoll(loop, opId, io->fd, events)) continue;
+      }
+      io->res = res;
+    } else {
+      ((pwa_Poll *) op->desc)->fds.revents = res >= 0 ? res : POLLERR;
+    }
+    _pwa_EventLoop_freeOp(loop, opId);
+    ++nRan;
+    _pwa_EventLoop_resume(loop, iter);
+  }
+  return nRan;
+}
+
+#endif
+
+int pwa_EventLoop_removeTask(pwa_EventLoop *, int);
+
+int pwa_EventLoop_addTask(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Poll *poll) {
+#ifdef PWA_URING
+  if (loop->backend == pwa_Backend_uring) return _pwa_Uring_addTask(loop, iterator, poll);
+#endif
+  struct pollfd *fds = &poll->fds;
   if (loop->nTasks == loop->nTaskAlloc) {
-    int nTaskAlloc = loop->nTaskAlloc += getpagesize();
-    loop->fds = (struct pollfd *) realloc(loop->fds, nTaskAlloc * sizeof(struct pollfd));
-    loop->tasks = (pwa_Task_AwaitFd *) realloc(loop->tasks, nTaskAlloc * sizeof(pwa_Task_AwaitFd));
+    int n = loop->nTaskAlloc, nAlloc = n << 1;
+    struct pollfd *newFds = (struct pollfd *) _pwa_EventLoop_realloc(loop, loop->fds,
+      (nAlloc + 1) * sizeof(struct pollfd), (n + 1) * sizeof(struct pollfd));
+    if (!newFds) { fds->revents = POLLERR; return 0; }
+    loop->fds = newFds;
+    pwa_Task_AwaitFd *tasks = (pwa_Task_AwaitFd *) _pwa_EventLoop_realloc(loop, loop->tasks,
+      nAlloc * sizeof(pwa_Task_AwaitFd), n * sizeof(pwa_Task_AwaitFd));
+    if (!tasks) { fds->revents = POLLERR; return 0; }
+    loop->tasks = tasks;
+    loop->nTaskAlloc = nAlloc;
   }
   int taskId = loop->nTasks++;
   loop->fds[taskId] = *fds;
-  loop->tasks[taskId] = (pwa_Task_AwaitFd) { iterator, fds };
+  loop->tasks[taskId] = (pwa_Task_AwaitFd) { iterator, poll, -1, -1 };
+  poll->slot = taskId;
+#ifdef PWA_EPOLL
+  if (loop->backend == pwa_Backend_epoll) {
+    pwa_EventLoop_FdWaiters *w = _pwa_EventLoop_fdWaiters(loop, fds->fd);
+    if (!w) { --loop->nTasks; fds->revents = POLLERR; return 0; }
+    unsigned match = w->pending & ((unsigned short) fds->events | POLLERR | POLLHUP);
+    if (match) { // watched fd got the edge before it was awaited
+      --loop->nTasks;
+      poll->slot = -1;
+      w->pending &= ~match | POLLERR | POLLHUP;
+      fds->revents = match;
+      return 0;
+    }
+    pwa_Task_AwaitFd *task = loop->tasks + taskId;
+    task->next = w->first;
+    if (w->first >= 0) loop->tasks[w->first].prev = taskId;
+    w->first = taskId;
+    unsigned events = w->events | (unsigned short) fds->events;
+    if (w->watched && events == w->events) return 1; // persistent registration: no syscall
+    if ((!w->armed || events != w->events) && _pwa_EventLoop_epollArm(loop, fds->fd, w, events)) {
+      // regular files (EPERM) are always ready, as with `poll()`; other failures are reported as `POLLNVAL`
+      fds->revents = errno == EPERM ? fds->events & (POLLIN | POLLOUT) : POLLNVAL;
+      pwa_EventLoop_removeTask(loop, taskId);
+      return 0;
+    }
+  }
+#endif
   return 1;
 }
 
 int pwa_EventLoop_removeTask(pwa_EventLoop *loop, int taskId) {
   if (taskId < 0 || taskId >= loop->nTasks) return 0;
+#ifdef PWA_EPOLL
+  if (loop->backend == pwa_Backend_epoll) _pwa_EventLoop_unlinkTask(loop, taskId);
+#endif
   int lastTaskId = --loop->nTasks;
   if (taskId != lastTaskId) {
     loop->fds[taskId] = loop->fds[lastTaskId];
     loop->tasks[taskId] = loop->tasks[lastTaskId];
+    loop->tasks[taskId].poll->slot = taskId;
+#ifdef PWA_EPOLL
+    if (loop->backend == pwa_Backend_epoll) _pwa_EventLoop_relinkTask(loop, taskId);
+#endif
   }
   return 1;
 }
 
-int pwa_EventLoop_addDelay(pwa_EventLoop *loop, pwa_Iterator *iterator, struct timespec *until) {
+// a task of the set may be gone (fired or hit), and its slot reused by another one
+static int _pwa_EventLoop_removeFds(pwa_EventLoop *loop, pwa_PollSet *set) {
+  int nRemoved = 0;
+  for (int i = 0; i < set->n; ++i) {
+    pwa_Poll *poll = set->polls + i;
+    int slot = poll->slot;
+    poll->slot = -1;
+#ifdef PWA_URING
+    if (loop->backend == pwa_Backend_uring) {
+      if (slot < 0 || slot >= loop->nOpAlloc || !loop->ops[slot].iterator || loop->ops[slot].desc != poll) continue;
+      _pwa_Uring_cancelOp(loop, slot);
+      ++nRemoved;
+      continue;
+    }
+#endif
+    if (slot < 0 || slot >= loop->nTasks || loop->tasks[slot].poll != poll) continue;
+    nRemoved += pwa_EventLoop_removeTask(loop, slot);
+  }
+  return nRemoved;
+}
+
+// fds that are ready or failed right away resume the job at once, as with a single fd
+int pwa_EventLoop_awaitFds(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_PollSet *set) {
+  int ready = 0;
+  for (int i = 0; i < set->n; ++i) {
+    set->polls[i].slot = -1;
+    set->polls[i].fds.revents = 0;
+  }
+  for (int i = 0; i < set->n; ++i) {
+    if (!pwa_EventLoop_addTask(loop, iterator, set->polls + i)) ready = 1;
+  }
+  if (ready) _pwa_EventLoop_removeFds(loop, set);
+  return !ready;
+}
+
+// delays are kept in binary min-heap; each entry updates back-reference in its `pwa_Timer` when moved,
+// so insert, cancel and removal of expired delay are O(log n), and the nearest deadline is O(1)
+
+static inline void _pwa_EventLoop_putDelay(pwa_EventLoop *loop, int delayId, pwa_Task_Delay *delay) {
+  loop->delays[delayId] = *delay;
+  delay->timer->slot = delayId;
+}
+
+static void _pwa_EventLoop_siftDelay(pwa_EventLoop *loop, int delayId) {
+  pwa_Task_Delay delay = loop->delays[delayId], *delays = loop->delays;
+  int n = loop->nDelays, parentId, childId;
+
+  while (delayId && pwa_timespec_cmp(&delay.until, &delays[parentId = (delayId - 1) >> 1].until) < 0) {
+    _pwa_EventLoop_putDelay(loop, delayId, delays + parentId);
+    delayId = parentId;
+  }
+  while ((childId = (delayId << 1) + 1) < n) {
+    if (childId + 1 < n && pwa_timespec_cmp(&delays[childId + 1].until, &delays[childId].until) < 0) ++childId;
+    if (pwa_timespec_cmp(&delays[childId].until, &delay.until) >= 0) break;
+    _pwa_EventLoop_putDelay(loop, delayId, delays + childId);
+    delayId = childId;
+  }
+  _pwa_EventLoop_putDelay(loop, delayId, &delay);
+}
+
+int pwa_EventLoop_addDelay(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Timer *timer) {
+  if (timer->sec >= 0) {
+    timer->until = loop->now;
+    pwa_timespec_add_sec(&timer->until, timer->sec);
+  }
   if (loop->nDelays == loop->nDelayAlloc) {
-    int nDelayAlloc = loop->nDelayAlloc += getpagesize();
-    loop->delays = (pwa_Task_Delay *) realloc(loop->delays, nDelayAlloc * sizeof(pwa_Task_Delay));
+    int n = loop->nDelayAlloc, nAlloc = n << 1;
+    pwa_Task_Delay *delays = (pwa_Task_Delay *) _pwa_EventLoop_realloc(loop, loop->delays,
+      nAlloc * sizeof(pwa_Task_Delay), n * sizeof(pwa_Task_Delay));
+    if (!delays) { timer->failed = 1; errno = ENOMEM; return 0; } // no room -- resume at once
+    loop->delays = delays;
+    loop->nDelayAlloc = nAlloc;
   }
+  timer->failed = 0;
   int delayId = loop->nDelays++;
-  pwa_Task_Delay *delay = loop->delays + delayId;
-  delay->iterator = iterator;
-  delay->until = *until;
+  _pwa_EventLoop_putDelay(loop, delayId, &(pwa_Task_Delay) { iterator, timer->until, timer });
+  _pwa_EventLoop_siftDelay(loop, delayId);
   return 1;
 }
 
 int pwa_EventLoop_removeDelay(pwa_EventLoop *loop, int delayId) {
   if (delayId < 0 || delayId >= loop->nDelays) return 0;
+  loop->delays[delayId].timer->slot = -1;
   int lastDelayId = --loop->nDelays;
   if (delayId != lastDelayId) {
-    loop->delays[delayId] = loop->delays[lastDelayId];
+    _pwa_EventLoop_putDelay(loop, delayId, loop->delays + lastDelayId);
+    _pwa_EventLoop_siftDelay(loop, delayId);
   }
   return 1;
 }
 
+static inline int _pwa_EventLoop_hasTimer(pwa_EventLoop *loop, pwa_Timer *timer) {
+  int slot = timer->slot;
+  return slot >= 0 && slot < loop->nDelays && loop->delays[slot].timer == timer;
+}
+
+static int _pwa_EventLoop_dropTimer(pwa_EventLoop *loop, pwa_Timer *timer) {
+  return _pwa_EventLoop_hasTimer(loop, timer) && pwa_EventLoop_removeDelay(loop, timer->slot);
+}
+
+static ssize_t _pwa_Io_exec(pwa_Task_Io *io) {
+  ssize_t res = -1;
+  int err;
+  socklen_t errLen = sizeof(err);
+  switch (io->op) {
+    case pwa_Io_read:
+      res = io->offset < 0 ? read(io->fd, io->buf, io->len) : pread(io->fd, io->buf, io->len, io->offset); break;
+    case pwa_Io_write:
+      res = io->offset < 0 ? write(io->fd, io->buf, io->len) : pwrite(io->fd, io->buf, io->len, io->offset); break;
+    case pwa_Io_accept:
+#if defined __linux__ && defined _GNU_SOURCE
+      res = accept4(io->fd, (struct sockaddr *) io->buf, io->addrLen, io->flags); break;
+#elif defined __linux__ && defined SYS_accept4
+      res = syscall(SYS_accept4, io->fd, (struct sockaddr *) io->buf, io->addrLen, io->flags); break;
+#else
+      res = accept(io->fd, (struct sockaddr *) io->buf, io->addrLen);
+  #ifdef SOCK_NONBLOCK
+      if (res != -1 && io->flags & SOCK_NONBLOCK) fcntl(res, F_SETFL, fcntl(res, F_GETFL) | O_NONBLOCK);
+  #endif
+      break;
+#endif
+    case pwa_Io_connect:
+      if (!io->started) {
+        res = connect(io->fd, (struct sockaddr *) io->buf, io->len);
+        if (res == -1 && errno == EINPROGRESS) { io->started = 1; errno = EAGAIN; }
+      } else if (!(res = getsockopt(io->fd, SOL_SOCKET, SO_ERROR, &err, &errLen)) && err) {
+        errno = err; res = -1;
+      }
+      break;
+    case pwa_Io_fsync: res = fsync(io->fd); break;
+  }
+  return res == -1 ? (errno == EWOULDBLOCK ? -EAGAIN : -errno) : res;
+}
+
+// persistent fd registration; a no-op for backends without one, which register fd per await anyway
+int pwa_EventLoop_watchFd(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Poll *poll) {
+  poll->fds.revents = 0;
+#ifdef PWA_EPOLL
+  if (loop->backend != pwa_Backend_epoll) return 0;
+  int fd = poll->fds.fd;
+  pwa_EventLoop_FdWaiters *w = _pwa_EventLoop_fdWaiters(loop, fd);
+  if (!w) { poll->fds.revents = POLLNVAL; return 0; }
+  char watched = w->watched;
+  w->watched = 1;
+  if (_pwa_EventLoop_epollArm(loop, fd, w, w->events | (unsigned short) poll->fds.events)) {
+    w->watched = watched;
+    poll->fds.revents = POLLNVAL;
+  }
+#endif
+  return 0;
+}
+
+int pwa_EventLoop_unwatchFd(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Poll *poll) {
+#ifdef PWA_EPOLL
+  int fd = poll->fds.fd;
+  if (loop->backend != pwa_Backend_epoll || fd < 0 || fd >= loop->nFdWaiterAlloc) return 0;
+  pwa_EventLoop_FdWaiters *w = loop->fdWaiters + fd;
+  if (!w->watched) return 0;
+  w->watched = 0;
+  w->pending = 0;
+  unsigned events = 0;
+  for (int taskId = w->first; taskId >= 0; taskId = loop->tasks[taskId].next) events |= (unsigned short) loop->fds[taskId].events;
+  if (events) { _pwa_EventLoop_epollArm(loop, fd, w, events); return 0; } // back to one-shot for remaining tasks
+  epoll_ctl(loop->backendFd, EPOLL_CTL_DEL, fd, &(struct epoll_event) { 0 });
+  w->events = 0;
+  w->armed = w->registered = 0;
+#endif
+  return 0;
+}
+
+int pwa_EventLoop_action_io(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Task_Io *io) {
+#ifdef PWA_URING
+  if (loop->backend == pwa_Backend_uring) return _pwa_Uring_addIo(loop, iterator, io);
+#endif
+  io->res = _pwa_Io_exec(io);
+  if (io->res != -EAGAIN) return 0;
+  io->poll.fds.fd = io->fd;
+  io->poll.fds.events = io->op == pwa_Io_read || io->op == pwa_Io_accept ? POLLIN : POLLOUT;
+  io->poll.fds.revents = 0;
+  return pwa_EventLoop_addTask(loop, iterator, &io->poll);
+}
+
+static void _pwa_Offload_exec(pwa_Offload *offload) {
+  pwa_Iterator *iter = offload->iterator;
+  do iter->next(iter, 0); while (offload->exec && !(iter->state & _pwi_state_stall));
+}
+
+static int _pwa_App_queueOffload(pwa_Offload *);
+
+// the job is parked outside of loop storage, and its loop is held until the offload is posted back
+int pwa_EventLoop_offload(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Offload *offload) {
+  if (loop->wakeFd != -1) {
+    offload->loop = loop;
+    offload->post.hit = (pwa_Task_HitJob) { iterator, pwa_Task_post_resume };
+    __atomic_add_fetch(&loop->nHolds, 1, __ATOMIC_ACQ_REL);
+    if (!_pwa_App_queueOffload(offload)) return 1;
+    __atomic_sub_fetch(&loop->nHolds, 1, __ATOMIC_ACQ_REL);
+  }
+  _pwa_Offload_exec(offload);
+  return 0;
+}
+
+// wait lists: the job is parked outside of loop storage, and only linked to loop for hits
+
+int pwa_EventLoop_wait(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Wait *wait) {
+  pwa_WaitList *list = wait->list;
+  wait->iterator = iterator;
+  wait->n = 0;
+  wait->next = 0;
+  wait->prev = list->last;
+  if (list->last) list->last->next = wait;
+  else list->first = wait;
+  list->last = wait;
+  wait->prevInLoop = 0;
+  wait->nextInLoop = loop->waits;
+  if (loop->waits) loop->waits->prevInLoop = wait;
+  loop->waits = wait;
+  return 1;
+}
+
+static void _pwa_EventLoop_unlinkWait(pwa_EventLoop *loop, pwa_Wait *wait) {
+  pwa_WaitList *list = wait->list;
+  if (wait->prev) wait->prev->next = wait->next;
+  else list->first = wait->next;
+  if (wait->next) wait->next->prev = wait->prev;
+  else list->last = wait->prev;
+  if (wait->prevInLoop) wait->prevInLoop->nextInLoop = wait->nextInLoop;
+  else loop->waits = wait->nextInLoop;
+  if (wait->nextInLoop) wait->nextInLoop->prevInLoop = wait->prevInLoop;
+  wait->list = 0;
+}
+
+int pwa_EventLoop_wakeWaits(pwa_EventLoop *loop, pwa_Iterator *ignored, pwa_Wait *wake) {
+  pwa_WaitList *list = wake->list;
+  for (int n = wake->n; n && list->first; --n) {
+    pwa_Wait *wait = list->first;
+    pwa_Iterator *iter = wait->iterator;
+    _pwa_EventLoop_unlinkWait(loop, wait);
+    wait->n = 1;
+    _pwa_EventLoop_resume(loop, iter);
+    if (list->tokens) {
+      wait->woken = list;
+      _pwa_EventLoop_lockQueue(loop);
+      pwa_EventLoop_Queued *queued = _pwa_EventLoop_queued(loop, iter);
+      if (queued) queued->tag = wait; // not read by the job on resume
+      _pwa_EventLoop_unlockQueue(loop);
+      iter->state |= pwa_Task_token_bit;
+    }
+  }
+  return 0;
+}
+
+// job holding a token is finished before it runs: the token is taken from it to be passed on.
+// `wait` is its descriptor kept in run queue; returns the list the token came from
+static pwa_WaitList * _pwa_EventLoop_takeToken(pwa_Iterator *iter, void *wait, char how) {
+  if (!(iter->state & pwa_Task_token_bit) || how == pwa_Task_hit_detach || how == pwa_Task_hit_force_next) return 0;
+  iter->state &= ~pwa_Task_token_bit;
+  return ((pwa_Wait *) wait)->woken;
+}
+
+// the token goes to the next waiter, or back to the list
+static void _pwa_EventLoop_passToken(pwa_EventLoop *loop, pwa_WaitList *list, char wake) {
+  if (wake && list->first) pwa_EventLoop_wakeWaits(loop, 0, &(pwa_Wait) { .list = list, .n = 1 });
+  else ++*list->tokens;
+}
+
+static inline int _pwa_Join_settled(pwa_Join *join) {
+  switch (join->mode) {
+    case pwa_Join_race: return join->nDone > 0;
+    case pwa_Join_any: return join->first >= 0 || join->nDone == join->n;
+    default: return join->nDone == join->n;
+  }
+}
+
+static void _pwa_Join_cancel(pwa_EventLoop *loop, pwa_Join *join, pwa_Iterator *except) {
+  join->cancelled = 1;
+  for (int i = 0; i < join->n; ++i) {
+    pwa_Iterator *task = (pwa_Iterator *) (join->tasks + i);
+    if (task == except || task->state & _pwi_state_done_bit) continue;
+    pwa_EventLoop_hitJob(loop, 0, &(pwa_Task_HitJob) { task, pwa_Task_hit_finish });
+  }
+}
+
+// called by parent to start the tasks and park, then by each task when it's done
+int pwa_EventLoop_join(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Join *join) {
+  if (!join->iterator) {
+    if (_pwa_EventLoop_reserveQueue(loop, join->n)) return 0; // not started: `pwa_join_` throws alloc error
+    join->iterator = iterator;
+    for (int i = 0; i < join->n; ++i) _pwa_EventLoop_enqueueAsync(loop, (pwa_Iterator *) (join->tasks + i));
+    join->wait.list = &join->waiters;
+    return pwa_EventLoop_wait(loop, iterator, &join->wait);
+  }
+  if (join->nDone < join->n) {
+    if (!join->cancelled && _pwa_Join_settled(join)) _pwa_Join_cancel(loop, join, iterator);
+    return 0;
+  }
+  if (join->hitting) { // parent's locals may go away from now on
+    pwa_Iterator *parent = join->iterator;
+    char how = join->how, goesOn = how == pwa_Task_post_resume || how == pwa_Task_hit_detach || how == pwa_Task_hit_force_next;
+    if (!goesOn) { // parent doesn't get back to `pwa_join_` to free the tasks; this one is not resumed
+      free(join->tasks);
+      join->tasks = 0;
+    }
+    if (how == pwa_Task_post_resume) _pwa_EventLoop_resume(loop, parent);
+    else pwa_EventLoop_hitIter(loop, parent, how);
+    return !goesOn;
+  }
+  if (join->wait.list) pwa_EventLoop_wakeWaits(loop, 0, &(pwa_Wait) { .list = &join->waiters, .n = 1 });
+  return 0;
+}
+
 int pwa_EventLoop_action_async(pwa_EventLoop *, pwa_Iterator *, pwa_Iterator *);
 static void _pwa_EventLoop_addJob(pwa_EventLoop *, pwa_Iterator *, void *);
 
-int pwa_EventLoop_hitIter(pwa_EventLoop *loop, pwa_Iterator *iter, char how) {
+// run queue: iterators woken up by events are queued and resumed by `pwa_EventLoop_execQueue`
+// within per-turn budget instead of being run from inside event dispatch
+
+static inline void _pwa_EventLoop_lockQueue(pwa_EventLoop *loop) {
+  if (loop->group) while (__atomic_exchange_n(&loop->queueLock, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(&loop->queueLock, __ATOMIC_RELAXED));
+  }
+}
+
+static inline void _pwa_EventLoop_unlockQueue(pwa_EventLoop *loop) {
+  if (loop->group) __atomic_store_n(&loop->queueLock, 0, __ATOMIC_RELEASE);
+}
+
+// positions run on and wrap around; consecutive ones stay distinct modulo the doubled size, so they are kept
+static int _pwa_EventLoop_growQueue(pwa_EventLoop *loop, int nAlloc) {
+  int n = loop->nQueueAlloc;
+  pwa_EventLoop_Queued *queue = (pwa_EventLoop_Queued *) malloc(nAlloc * sizeof(pwa_EventLoop_Queued));
+  if (!queue) return -1;
+  for (unsigned i = 0, pos = loop->queueHead; i < (unsigned) loop->nQueued; ++i, ++pos) {
+    queue[pos & (nAlloc - 1)] = loop->queue[pos & (n - 1)];
+  }
+  free(loop->queue);
+  loop->queue = queue;
+  loop->nQueueAlloc = nAlloc;
+  return 0;
+}
+
+// make room for `n` more iterators, where failure can be reported before they are taken out of where they're parked
+static int _pwa_EventLoop_reserveQueue(pwa_EventLoop *loop, int n) {
+  if (loop->nQueued + n <= loop->nQueueAlloc) return 0;
+  int nAlloc = loop->nQueueAlloc ? loop->nQueueAlloc << 1 : 64;
+  while (nAlloc < loop->nQueued + n) nAlloc <<= 1;
+  _pwa_EventLoop_lockQueue(loop);
+  int res = _pwa_EventLoop_growQueue(loop, nAlloc);
+  _pwa_EventLoop_unlockQueue(loop);
+  return res;
+}
+
+// returns -1, if the queue is full and can't grow; the iterator isn't queued then
+static int _pwa_EventLoop_pushQueue(pwa_EventLoop *loop, pwa_Iterator *iter) {
+  if (loop->nQueued == loop->nQueueAlloc && _pwa_EventLoop_growQueue(loop, loop->nQueueAlloc ? loop->nQueueAlloc << 1 : 64)) {
+    return -1;
+  }
+  unsigned pos = loop->queueHead + loop->nQueued++;
+  loop->queue[pos & (loop->nQueueAlloc - 1)] = (pwa_EventLoop_Queued) { iter, iter->tag };
+  iter->tag = (void *) (size_t) pos;
+  iter->state |= pwa_Task_queued_bit;
+  return 0;
+}
+
+// take the first entry; null, if it was detached. an entry of an iterator, which isn't queued at its position
+// anymore (e.g. it was reinitialized and queued again), is stale: its saved tag is not written back
+static pwa_Iterator * _pwa_EventLoop_popQueue(pwa_EventLoop *loop) {
+  unsigned pos = loop->queueHead++;
+  pwa_EventLoop_Queued *queued = loop->queue + (pos & (loop->nQueueAlloc - 1));
+  --loop->nQueued;
+  pwa_Iterator *iter = queued->iterator;
+  if (!iter || !(iter->state & pwa_Task_queued_bit) || (unsigned) (size_t) iter->tag != pos) return 0;
+  iter->tag = queued->tag;
+  iter->state &= ~pwa_Task_queued_bit;
+  return iter;
+}
+
+// entry of queued iterator by the position in its `tag`; O(1). null, if it's queued by another loop
+static pwa_EventLoop_Queued * _pwa_EventLoop_queued(pwa_EventLoop *loop, pwa_Iterator *iter) {
+  unsigned pos = (unsigned) (size_t) iter->tag;
+  if (!(iter->state & pwa_Task_queued_bit) || pos - loop->queueHead >= (unsigned) loop->nQueued) return 0;
+  pwa_EventLoop_Queued *queued = loop->queue + (pos & (loop->nQueueAlloc - 1));
+  return queued->iterator == iter ? queued : 0;
+}
+
+// detach queued iterator: its entry is emptied, so that run queue doesn't touch it anymore.
+// queue is locked by caller
+static void _pwa_EventLoop_dequeue(pwa_Iterator *iter, pwa_EventLoop_Queued *queued) {
+  iter->tag = queued->tag;
+  iter->state &= ~pwa_Task_queued_bit;
+  queued->iterator = 0;
+}
+
+static int _pwa_EventLoop_enqueue(pwa_EventLoop *loop, pwa_Iterator *iter) {
+  _pwa_EventLoop_lockQueue(loop);
+  int res = _pwa_EventLoop_pushQueue(loop, iter);
+  _pwa_EventLoop_unlockQueue(loop);
+  return res;
+}
+
+// check if iterator may be run by loop; adopt it, if it's awaiting outside of loop
+static int _pwa_EventLoop_adopt(pwa_Iterator *iter) {
+  if (iter->state & (_pwi_state_done_bit | pwa_Task_queued_bit)) return 0;
+  if (iter->state & pwa_Task_await_bit) {
+    if (iter->state & pwa_Task_attached_bit) return 0;
+    iter->state |= pwa_Task_attached_bit;
+  }
+  return 1;
+}
+
+// if the queue can't grow, the job is run right away, as jobs were before there was a run queue.
+// event dispatch reserves room for all jobs it may resume, so it doesn't run them from inside
+static void _pwa_EventLoop_enqueueAsync(pwa_EventLoop *loop, pwa_Iterator *iter) {
+  if (_pwa_EventLoop_adopt(iter) && _pwa_EventLoop_enqueue(loop, iter)) _pwa_EventLoop_addJob(loop, iter, 0);
+}
+
+// jobs queued meanwhile (e.g. woken by `pwa_wake`) run in the same turn while budget lasts, without polling
+int pwa_EventLoop_execQueue(pwa_EventLoop *loop) {
+  int n = loop->budget > 0 ? loop->budget : loop->nQueued, nRan = 0;
+  for (int i = 0; i < n; ++i) {
+    _pwa_EventLoop_lockQueue(loop);
+    if (!loop->nQueued) { _pwa_EventLoop_unlockQueue(loop); break; } // stolen
+    pwa_Iterator *iter = _pwa_EventLoop_popQueue(loop);
+    _pwa_EventLoop_unlockQueue(loop);
+    if (!iter) continue; // detached while queued
+    _pwa_EventLoop_addJob(loop, iter, 0);
+    ++nRan;
+  }
+  return nRan;
+}
+
+// apply hit to iterator's state; returns 0, if iterator is not to be resumed
+static int _pwa_EventLoop_hitState(pwa_Iterator *iter, char how) {
   switch (how) {
     case pwa_Task_hit_detach: iter->state &= ~pwa_Task_attached_bit; return 0;
     case pwa_Task_hit_force_finish: iter->state &= pwa_Task_await_clear;
-      if (!(iter->state & _pwi_state_final_bit)) *(int *)iter->state = (int) _pwi_state_final; break;
+      if (!(iter->state & _pwi_state_final_bit)) *(int *)&iter->state = (int) _pwi_state_final;
+      break;
     case pwa_Task_hit_finish: if (!(iter->state & _pwi_state_final_bit)) {
       iter->state = (iter->state & (pwa_Task_await_clear - _pwi_state_final_bit)) | (unsigned)(int) _pwi_state_final;
     } break;
     case pwa_Task_hit_kill:
-      iter->state = (unsigned)(int) _pwi_state_final | _pwi_state_final_bit | _pwi_state_done_bit; break;
+      iter->state = (unsigned)(int) _pwi_state_final | _pwi_state_final_bit | _pwi_state_done_bit |
+        (iter->state & pwa_Task_queued_bit);
+      break;
     case pwa_Task_hit_halt: *(int *)&iter->state = (int) _pwi_state_final; break;
     case pwa_Task_hit_force_next: iter->state &= pwa_Task_await_clear; break;
   }
+  return 1;
+}
 
-  _pwa_EventLoop_addJob(loop, iter, 0);
+// iterator awaiting several fds may be hit by each of its tasks
+int pwa_EventLoop_hitIter(pwa_EventLoop *loop, pwa_Iterator *iter, char how) {
+  // a killed one is done: nothing is left to run, so it's not queued
+  if (!_pwa_EventLoop_hitState(iter, how) || iter->state & (pwa_Task_queued_bit | _pwi_state_done_bit)) return 0;
+  if (_pwa_EventLoop_enqueue(loop, iter)) _pwa_EventLoop_addJob(loop, iter, 0); // queue can't grow
   return 0;
 }
 
+// find where the iterator is parked by back-reference in its await descriptor (`iter->tag`); O(1).
+// returns 2, if its I/O op is being cancelled, and the job is to be hit (`how`) by loop on its completion
+static int _pwa_EventLoop_unparkTask(pwa_EventLoop *loop, pwa_Iterator *iter, int task, void *desc, char how) {
+  int slot;
+  switch (task) {
+    case pwa_Task_delay: return _pwa_EventLoop_dropTimer(loop, (pwa_Timer *) desc);
+    case pwa_Task_wait:
+      if (!((pwa_Wait *) desc)->list) return 0;
+      _pwa_EventLoop_unlinkWait(loop, (pwa_Wait *) desc);
+      return 1;
+    case pwa_Task_await_fds: return _pwa_EventLoop_removeFds(loop, (pwa_PollSet *) desc) > 0;
+    case pwa_Task_deadline: { // timer of offload is kept, as offload itself is not cancelled
+      pwa_Deadline *d = (pwa_Deadline *) desc;
+      int unparked = _pwa_EventLoop_unparkTask(loop, iter, d->task, d->desc, how);
+      if (unparked) _pwa_EventLoop_dropTimer(loop, &d->timer);
+      return unparked;
+    }
+    case pwa_Task_join: { // children run in parent's locals, so the hit is deferred until they are done
+      pwa_Join *join = (pwa_Join *) desc;
+      if (!join->wait.list) return 0;
+      _pwa_EventLoop_unlinkWait(loop, &join->wait);
+      join->hitting = 1;
+      join->how = how;
+      if (!join->cancelled) _pwa_Join_cancel(loop, join, 0);
+      return 2;
+    }
+    case pwa_Task_await_fd: slot = ((pwa_Poll *) desc)->slot; break;
+    case pwa_Task_io: slot = ((pwa_Task_Io *) desc)->poll.slot; break;
+    default: return 0;
+  }
+#ifdef PWA_URING
+  if (loop->backend == pwa_Backend_uring) {
+    if (slot < 0 || slot >= loop->nOpAlloc || loop->ops[slot].iterator != iter) return 0;
+    if (task == pwa_Task_io) { _pwa_Uring_cancelIo(loop, slot, how); return 2; }
+    _pwa_Uring_cancelOp(loop, slot);
+    return 1;
+  }
+#endif
+  if (slot < 0 || slot >= loop->nTasks || loop->tasks[slot].iterator != iter) return 0;
+  return pwa_EventLoop_removeTask(loop, slot);
+}
+
+static inline int _pwa_EventLoop_unpark(pwa_EventLoop *loop, pwa_Iterator *iter, char how) {
+  if (!(iter->state & pwa_Task_await_bit)) return 0;
+  int task = (iter->state >> pwa_Task_await_shift) & pwa_Task_await_mask;
+  return _pwa_EventLoop_unparkTask(loop, iter, task, iter->tag, how);
+}
+
 int pwa_EventLoop_hitJob(pwa_EventLoop *loop, pwa_Iterator *ignored, pwa_Task_HitJob *hit) {
-  if (hit->how == pwa_Task_hit_finish && hit->iterator->state & _pwi_state_final_bit) return 0;
+  pwa_Iterator *iter = hit->iterator;
+  if (hit->how == pwa_Task_hit_finish && iter->state & _pwi_state_final_bit) return 0;
 
-  int n, found = 0;
+  int unparked = _pwa_EventLoop_unpark(loop, iter, hit->how);
+  if (unparked == 1) {
+    pwa_EventLoop_hitIter(loop, iter, hit->how);
+  } else if (!unparked && (iter->state & pwa_Task_queued_bit)) { // already queued -- only state is changed
+    // under the lock, so that a sibling loop of group doesn't steal it halfway
+    _pwa_EventLoop_lockQueue(loop);
+    pwa_EventLoop_Queued *queued = _pwa_EventLoop_queued(loop, iter);
+    if (!queued) { _pwa_EventLoop_unlockQueue(loop); return 0; } // stolen: its state is not ours to change
+    pwa_WaitList *list = _pwa_EventLoop_takeToken(iter, queued->tag, hit->how);
+    // detached or killed one is taken out, so that loop keeps no reference to it after the hit
+    if (!_pwa_EventLoop_hitState(iter, hit->how) || iter->state & _pwi_state_done_bit) _pwa_EventLoop_dequeue(iter, queued);
+    _pwa_EventLoop_unlockQueue(loop);
+    if (list) _pwa_EventLoop_passToken(loop, list, 1); // waking enqueues
+  }
+  return 0;
+}
+
+// jobs parked in wait lists of the loop; deadlines around them are dropped, when they run
+static void _pwa_EventLoop_hitWaits(pwa_EventLoop *loop, char how) {
+  while (loop->waits) {
+    pwa_Iterator *iter = loop->waits->iterator;
+    int task = (iter->state >> pwa_Task_await_shift) & pwa_Task_await_mask;
+    void *desc = iter->tag;
+    for (pwa_Deadline *d; task == pwa_Task_deadline; task = d->task, desc = d->desc) d = (pwa_Deadline *) desc;
+    _pwa_EventLoop_unlinkWait(loop, loop->waits);
+    if (task == pwa_Task_join) { // its tasks are hit here too; it's hit, once they are done
+      ((pwa_Join *) desc)->hitting = 1;
+      ((pwa_Join *) desc)->how = how;
+      continue;
+    }
+    pwa_EventLoop_hitIter(loop, iter, how);
+  }
+}
+
+// hits only move iterators to run queue, so storage is emptied and kept for reuse
+int pwa_EventLoop_hitAllJobs(pwa_EventLoop *loop, pwa_Iterator *ignored, ssize_t how) {
+  int nTasks = loop->nTasks, nDelays = loop->nDelays, nWaits = 0;
+  for (pwa_Wait *wait = loop->waits; wait; wait = wait->nextInLoop) ++nWaits;
+  if (_pwa_EventLoop_reserveQueue(loop, nTasks + nDelays + loop->nOps + nWaits)) return -1; // none is hit
   pwa_Task_AwaitFd *task = loop->tasks;
   pwa_Task_Delay *delay = loop->delays;
-  pwa_Iterator *iter = hit->iterator;
-  n = loop->nTasks;
-  if (n) for (int i = 0; i < n; ++i, ++task) {
-    if (task->iterator == iter) {
-      pwa_EventLoop_removeTask(loop, i);
-      found = 1;
-      break;
-    }
+  loop->nTasks = loop->nDelays = 0;
+  for (int i = 0; i < loop->nFdWaiterAlloc; ++i) loop->fdWaiters[i].first = -1;
+  _pwa_EventLoop_lockQueue(loop);
+  for (int i = 0, n = loop->nQueued, mask = loop->nQueueAlloc - 1; i < n; ++i) {
+    pwa_EventLoop_Queued *queued = loop->queue + ((loop->queueHead + i) & mask);
+    pwa_Iterator *iter = queued->iterator;
+    if (!iter) continue;
+    pwa_WaitList *list = _pwa_EventLoop_takeToken(iter, queued->tag, how);
+    if (list) _pwa_EventLoop_passToken(loop, list, 0); // waiters are hit too
+    if (!_pwa_EventLoop_hitState(iter, how) || iter->state & _pwi_state_done_bit) _pwa_EventLoop_dequeue(iter, queued);
   }
-  n = loop->nDelays;
-  if (n && !found) for (int i = 0; i < n; ++i, ++delay) {
-    if (delay->iterator == iter) {
-      pwa_EventLoop_removeDelay(loop, i);
-      found = 1;
-      break;
-    }
+  _pwa_EventLoop_unlockQueue(loop);
+#ifdef PWA_URING
+  for (int i = 0, n = loop->nOpAlloc; loop->nOps && i < n; ++i) {
+    pwa_Iterator *iter = loop->ops[i].iterator;
+    if (!iter) continue;
+    if (loop->ops[i].task == pwa_Task_io) { _pwa_Uring_cancelIo(loop, i, (char) how); continue; }
+    _pwa_Uring_cancelOp(loop, i);
+    pwa_EventLoop_hitIter(loop, iter, how);
+  }
+#endif
+  for (int i = 0; i < nTasks; ++i, ++task) {
+    task->poll->slot = -1;
+    pwa_EventLoop_hitIter(loop, task->iterator, how);
+  }
+  for (int i = 0; i < nDelays; ++i, ++delay) {
+    delay->timer->slot = -1;
+    if (delay->timer->deadline) continue; // its job is hit by the task bounded by it, or in queue
+    pwa_EventLoop_hitIter(loop, delay->iterator, how);
   }
-  if (!found) return 0;
-  pwa_EventLoop_hitIter(loop, iter, hit->how);
+  _pwa_EventLoop_hitWaits(loop, how);
   return 0;
 }
 
-int pwa_EventLoop_hitAllJobs(pwa_EventLoop *loop, pwa_Iterator *ignored, ssize_t how) {
-  int nTasks = loop->nTasks, nDelays = loop->nDelays;
-  free(loop->fds);
-  pwa_Task_AwaitFd* tasks = loop->tasks, *task = tasks;
-  pwa_Task_Delay* delays = loop->delays, *delay = delays;
-  pwa_EventLoop_init(loop);
-  for (int i = 0; i < nTasks; ++i, ++task) pwa_EventLoop_hitIter(loop, task->iterator, how);
-  for (int i = 0; i < nDelays; ++i, ++delay) pwa_EventLoop_hitIter(loop, delay->iterator, how);
-  free(delays);
-  free(tasks);
+// resume tracing: the record slot is claimed only after `next()` returns, so a reader sees complete records
+// unless the ring wraps over them meanwhile
+
+int pwa_Trace_init(pwa_Trace *trace, int nRecords) {
+  unsigned n = 1;
+  while (n < (unsigned) nRecords) n <<= 1;
+  trace->records = (pwa_Trace_Record *) calloc(n, sizeof(pwa_Trace_Record));
+  if (!trace->records) return -1;
+  trace->mask = n - 1;
+  trace->head = 0;
+  return 0;
+}
+
+void pwa_Trace_free(pwa_Trace *trace) {
+  free(trace->records);
+  trace->records = 0;
+}
+
+int pwa_EventLoop_setTrace(pwa_EventLoop *loop, pwa_Trace *trace) {
+#ifdef PWA_TRACE
+  __atomic_store_n(&loop->trace, trace, __ATOMIC_RELEASE);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+#ifdef PWA_TRACE
+
+static inline unsigned long long _pwa_Trace_clock(pwa_EventLoop *loop) {
+  struct timespec ts;
+  clock_gettime(loop->clockId, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _pwa_Trace_next(pwa_EventLoop *loop, pwa_Trace *trace, pwa_Iterator *iter, void *arg) {
+  int label = (int) iter->state;
+  unsigned long long start = _pwa_Trace_clock(loop);
+  iter->next(iter, arg);
+  unsigned long long end = _pwa_Trace_clock(loop), head = trace->head;
+  pwa_Trace_Record *record = trace->records + (head & trace->mask);
+  record->iterator = iter;
+  record->startNsec = start;
+  record->endNsec = end;
+  record->label = label;
+  record->task = iter->state & pwa_Task_await_bit ? (iter->state >> pwa_Task_await_shift) & pwa_Task_await_mask : -1;
+  __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static const char *_pwa_Trace_taskNames[pwa_Task_count] = {
+  [pwa_Task_await_fd] = "await_fd", [pwa_Task_delay] = "delay", [pwa_Task_async_job] = "async_job",
+  [pwa_Task_hit_job] = "hit_job", [pwa_Task_hit_all_jobs] = "hit_all_jobs", [pwa_Task_io] = "io",
+  [pwa_Task_watch_fd] = "watch_fd", [pwa_Task_unwatch_fd] = "unwatch_fd", [pwa_Task_offload] = "offload",
+  [pwa_Task_wait] = "wait", [pwa_Task_wake] = "wake", [pwa_Task_join] = "join",
+  [pwa_Task_await_fds] = "await_fds", [pwa_Task_deadline] = "deadline",
+};
+
+int pwa_Trace_export(FILE *out, pwa_Trace **traces, int n) {
+  const char *sep = "";
+  if (fputs("{\"traceEvents\":[", out) < 0) return -1;
+  for (int tid = 0; tid < n; ++tid) {
+    pwa_Trace *trace = traces[tid];
+    unsigned long long head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    unsigned long long i = head > trace->mask ? head - trace->mask - 1 : 0;
+    for (; i < head; ++i) {
+      pwa_Trace_Record *r = trace->records + (i & trace->mask);
+      const char *task = r->task < 0 ? "none" : r->task < pwa_Task_count ? _pwa_Trace_taskNames[(int) r->task] : 0;
+      fprintf(out, "%s\n{\"name\":\"%p\",\"cat\":\"resume\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"label\":%d,\"await\":\"%s\"}}",
+        sep, (void *) r->iterator, tid, r->startNsec / 1e3, (r->endNsec - r->startNsec) / 1e3, r->label,
+        task ? task : "unknown");
+      sep = ",";
+    }
+  }
+  return fputs("\n]}\n", out) < 0 ? -1 : 0;
+}
+
+#endif
+
+int pwa_EventLoop_deadline(pwa_EventLoop *, pwa_Iterator *, pwa_Deadline *);
+
+// awaited by a job, which goes on either way; -1 (no room in run queue) is seen only by direct callers
+static int _pwa_EventLoop_action_hitAllJobs(pwa_EventLoop *loop, pwa_Iterator *iterator, ssize_t how) {
+  pwa_EventLoop_hitAllJobs(loop, iterator, how);
   return 0;
 }
 
@@ -131,12 +1345,46 @@ pwa_EventLoop_Action pwa_EventLoop_actions[] = {
   [pwa_Task_delay] = (pwa_EventLoop_Action) pwa_EventLoop_addDelay,
   [pwa_Task_async_job] = (pwa_EventLoop_Action) pwa_EventLoop_action_async,
   [pwa_Task_hit_job] = (pwa_EventLoop_Action) pwa_EventLoop_hitJob,
-  [pwa_Task_hit_all_jobs] = (pwa_EventLoop_Action) pwa_EventLoop_hitAllJobs,
+  [pwa_Task_hit_all_jobs] = (pwa_EventLoop_Action) _pwa_EventLoop_action_hitAllJobs,
+  [pwa_Task_io] = (pwa_EventLoop_Action) pwa_EventLoop_action_io,
+  [pwa_Task_watch_fd] = (pwa_EventLoop_Action) pwa_EventLoop_watchFd,
+  [pwa_Task_unwatch_fd] = (pwa_EventLoop_Action) pwa_EventLoop_unwatchFd,
+  [pwa_Task_offload] = (pwa_EventLoop_Action) pwa_EventLoop_offload,
+  [pwa_Task_wait] = (pwa_EventLoop_Action) pwa_EventLoop_wait,
+  [pwa_Task_wake] = (pwa_EventLoop_Action) pwa_EventLoop_wakeWaits,
+  [pwa_Task_join] = (pwa_EventLoop_Action) pwa_EventLoop_join,
+  [pwa_Task_await_fds] = (pwa_EventLoop_Action) pwa_EventLoop_awaitFds,
+  [pwa_Task_deadline] = (pwa_EventLoop_Action) pwa_EventLoop_deadline,
 };
 
+// the timer is set on first park, and kept for the next ones of the same scope until it's over
+int pwa_EventLoop_deadline(pwa_EventLoop *loop, pwa_Iterator *iterator, pwa_Deadline *d) {
+  if (d->task < 0 || d->timedOut) { _pwa_EventLoop_dropTimer(loop, &d->timer); return 0; }
+  if (!_pwa_EventLoop_hasTimer(loop, &d->timer)) {
+    d->timer.deadline = 1;
+    if (!pwa_EventLoop_addDelay(loop, iterator, &d->timer)) { d->timedOut = 1; return 0; } // no room
+    d->timer.sec = -1; // `until` is kept
+  }
+  pwa_EventLoop_Action action = pwa_EventLoop_actions[d->task];
+  if (action && action(loop, iterator, d->desc)) return 1;
+  if (d->once) _pwa_EventLoop_dropTimer(loop, &d->timer);
+  return 0;
+}
+
 static void _pwa_EventLoop_addJob(pwa_EventLoop *loop, pwa_Iterator *iter, void *arg) {
+  int nResumes = loop->maxResumes;
   while (1) {
-    while (!(iter->state & _pwi_state_stall)) { iter->next(iter, arg); } // fast-forward until async or done
+    while (!(iter->state & _pwi_state_stall)) { // fast-forward until async or done
+      if (!nResumes--) { // let other jobs run; if the queue can't grow, this one runs on
+        if (!_pwa_EventLoop_enqueue(loop, iter)) return;
+        nResumes = loop->maxResumes;
+      }
+#ifdef PWA_TRACE
+      pwa_Trace *trace = loop->trace;
+      if (trace) { _pwa_Trace_next(loop, trace, iter, arg); continue; }
+#endif
+      iter->next(iter, arg);
+    }
     if (!(iter->state & pwa_Task_await_bit)) { return; } // if iterator done or race condition
     pwa_EventLoop_Action action = pwa_EventLoop_actions[(iter->state >> pwa_Task_await_shift) & pwa_Task_await_mask];
     if (!action) continue; // not implemented task -- ignore
@@ -144,41 +1392,41 @@ static void _pwa_EventLoop_addJob(pwa_EventLoop *loop, pwa_Iterator *iter, void
     iter->state &= pwa_Task_await_clear;
   }
 }
-
-void pwa_EventLoop_addAsync(pwa_EventLoop *loop, pwa_Iterator *iter, void* arg) {
-  if (iter->state & _pwi_state_done_bit) return;
-  if (iter->state & pwa_Task_await_bit) {
-    if (iter->state & pwa_Task_attached_bit) return;
-    iter->state |= pwa_Task_attached_bit;
-  }
-  _pwa_EventLoop_addJob(loop, iter, arg);
+
+void pwa_EventLoop_addAsync(pwa_EventLoop *loop, pwa_Iterator *iter, void* arg) {
+  if (_pwa_EventLoop_adopt(iter)) _pwa_EventLoop_addJob(loop, iter, arg);
 }
 
 int pwa_EventLoop_action_async(pwa_EventLoop *loop, pwa_Iterator *ignore, pwa_Iterator *iterator) {
   if (!loop) return 0;
-  pwa_EventLoop_addAsync(loop, iterator, 0);
+  _pwa_EventLoop_enqueueAsync(loop, iterator);
   return 0;
 }
 
 #define pwa_EventLoop_maxWaitSec 1e6
 #define pwa_EventLoop_maxWaitMsec (pwa_EventLoop_maxWaitSec * 1000)
 
+struct timespec * pwa_EventLoop_updateNow(pwa_EventLoop *loop) {
+  return clock_gettime(loop->clockId, &loop->now) ? 0 : &loop->now;
+}
+
+// `span` is exact; returned msec are rounded up, so that backends waiting in msec don't spin before deadline
+
 int pwa_EventLoop_getWaitTimeout(pwa_EventLoop *loop, struct timespec *span) {
   int n = loop->nDelays;
+  if (loop->nQueued || __atomic_load_n(&loop->posts, __ATOMIC_RELAXED)) {
+    span->tv_sec = 0;
+    span->tv_nsec = 0;
+    return 0;
+  }
   if (!n) {
     span->tv_sec = pwa_EventLoop_maxWaitSec;
     span->tv_nsec = 0;
     return pwa_EventLoop_maxWaitMsec;
   }
-  pwa_Task_Delay *delay = loop->delays;
-  struct timespec now, min = delay->until;
-  ++delay;
-  for (int i = 1; i < n; ++i, ++delay) {
-    if (pwa_timespec_cmp(&delay->until, &min) < 0) min = delay->until;
-  }
-  if (clock_gettime(CLOCK_MONOTONIC, &now)) { return -1; };
-  pwa_timespec_diff(span, &min, &now);
-  if (span->tv_sec < 0) {
+  struct timespec min = loop->delays->until;
+  pwa_timespec_diff(span, &min, &loop->now);
+  if (span->tv_sec < 0 || (!span->tv_sec && !span->tv_nsec)) {
     span->tv_sec = 0;
     span->tv_nsec = 0;
     return 0;
@@ -188,74 +1436,275 @@ int pwa_EventLoop_getWaitTimeout(pwa_EventLoop *loop, struct timespec *span) {
     span->tv_nsec = 0;
     return pwa_EventLoop_maxWaitMsec;
   }
-  return span->tv_sec * 1e3 + span->tv_nsec / 1e6;
+  return span->tv_sec * 1000 + (span->tv_nsec + 999999) / 1000000;
 }
 
 int pwa_EventLoop_pollEvents(pwa_EventLoop *loop, struct timespec *span, int timeoutMsec) {
-  if (!timeoutMsec) return 0;
-  if (!loop->nTasks) {
-    if (nanosleep(span, NULL) && errno != EINTR) { return -3; }
+#ifdef PWA_URING
+  if (loop->backend == pwa_Backend_uring) {
+    if (loop->wakeFd != -1 && !loop->wakeArmed) {
+      struct io_uring_sqe *sqe = _pwa_Uring_getSqe(loop);
+      if (sqe) {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = loop->wakeFd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = pwa_Uring_wake;
+        _pwa_Uring_pushSqe(loop);
+        loop->wakeArmed = 1;
+      }
+    }
+    int waits = loop->nOps || loop->wakeArmed;
+    _pwa_EventLoop_count(++loop->metrics.nPolls);
+    if (_pwa_Uring_enter(loop, timeoutMsec && waits, timeoutMsec ? span : 0)) return -2;
+    if (timeoutMsec && !waits && nanosleep(span, NULL) && errno != EINTR) { return -3; }
+    return __atomic_load_n(loop->uring->cqTail, __ATOMIC_ACQUIRE) - *loop->uring->cqHead;
+  }
+#endif
+  int wakes = loop->wakeFd != -1;
+  if (!loop->nTasks && !wakes) {
+    if (timeoutMsec && nanosleep(span, NULL) && errno != EINTR) { return -3; }
     return 0;
   }
-  int polled = poll(loop->fds, loop->nTasks, timeoutMsec);
+  int polled;
+  _pwa_EventLoop_count(++loop->metrics.nPolls);
+#ifdef PWA_EPOLL
+  if (loop->backend == pwa_Backend_epoll) {
+    if (loop->nEventAlloc < loop->nTasks + wakes) {
+      int nAlloc = loop->nEventAlloc ? loop->nEventAlloc : 64;
+      while (nAlloc < loop->nTasks + wakes) nAlloc <<= 1;
+      void *events = realloc(loop->events, nAlloc * sizeof(struct epoll_event));
+      if (events) { loop->events = events; loop->nEventAlloc = nAlloc; }
+    }
+    polled = -1;
+#ifdef SYS_epoll_pwait2
+    static char noPwait2 = 0; // kernel before 5.11
+    if (!noPwait2) {
+      polled = syscall(SYS_epoll_pwait2, loop->backendFd, loop->events, loop->nEventAlloc,
+        timeoutMsec ? span : &(struct timespec) { 0, 0 }, NULL, 0);
+      if (polled == -1 && errno == ENOSYS) noPwait2 = 1;
+    }
+    if (noPwait2)
+#endif
+    polled = epoll_wait(loop->backendFd, (struct epoll_event *) loop->events, loop->nEventAlloc, timeoutMsec);
+  } else
+#endif
+  {
+    if (wakes) loop->fds[loop->nTasks] = (struct pollfd) { loop->wakeFd, POLLIN, 0 }; // spare entry past tasks
+#ifdef SYS_ppoll
+    polled = syscall(SYS_ppoll, loop->fds, loop->nTasks + wakes, timeoutMsec ? span : &(struct timespec) { 0, 0 }, NULL, 0);
+#else
+    polled = poll(loop->fds, loop->nTasks + wakes, timeoutMsec);
+#endif
+  }
   if (polled == -1) return errno == EINTR ? 0 : -2;
   return polled;
 }
 
-int pwa_EventLoop_execTasks(pwa_EventLoop *loop, int polled) {
-  if (!polled) return 0;
+#ifdef PWA_EPOLL
+
+static int _pwa_EventLoop_execEpollTasks(pwa_EventLoop *loop, int polled) {
+  struct epoll_event *ev = (struct epoll_event *) loop->events;
+
+  for (int e = 0; e < polled; ++e, ++ev) {
+    int fd = ev->data.fd;
+    if (fd == loop->wakeFd) { _pwa_EventLoop_drainWake(loop); continue; }
+    pwa_EventLoop_FdWaiters *w = loop->fdWaiters + fd;
+    unsigned rest = 0, revents = ev->events, delivered = 0;
+    if (!w->watched) w->armed = 0; // one-shot registration is disabled by kernel after firing
+
+    for (int taskId = w->first, next; taskId >= 0; taskId = next) {
+      pwa_Task_AwaitFd *task = loop->tasks + taskId;
+      pwa_Iterator *iter = task->iterator;
+      unsigned events = (unsigned short) loop->fds[taskId].events, match = revents & (events | POLLERR | POLLHUP);
+      next = task->next;
+      if (!match) { rest |= events; continue; }
+      delivered |= match;
+      task->poll->fds.revents = match;
+      if (next == loop->nTasks - 1) next = taskId; // last task is moved into the removed slot
+      pwa_EventLoop_removeTask(loop, taskId);
+      _pwa_EventLoop_resume(loop, iter);
+    }
+
+    if (w->watched) { w->pending |= revents & ~delivered; continue; } // stays armed
+    w->events = 0;
+    if (rest) _pwa_EventLoop_epollArm(loop, fd, w, rest);
+  }
+  return polled;
+}
+
+#endif
 
+static int _pwa_EventLoop_execPollTasks(pwa_EventLoop *loop, int polled) {
   pwa_Iterator *iter;
   pwa_Task_AwaitFd *task = loop->tasks;
   struct pollfd *fds = loop->fds;
   int n = loop->nTasks, p = polled;
+  if (loop->wakeFd != -1 && fds[n].revents) { _pwa_EventLoop_drainWake(loop); --p; }
 
-  for (int i = 0; p && i < n; --p, ++i, ++fds, ++task) {
+  for (int i = 0; p && i < n; ++i, ++fds, ++task) {
     if (!fds->revents) continue;
+    --p;
     iter = task->iterator;
-    task->fds->revents = fds->revents;
-    iter->state &= pwa_Task_await_clear;
+    task->poll->fds.revents = fds->revents;
     pwa_EventLoop_removeTask(loop, i); --i; --n; --fds; --task;
-    pwa_EventLoop_addAsync(loop, iter, 0);
+    _pwa_EventLoop_resume(loop, iter);
   }
   return polled;
 }
 
+int pwa_EventLoop_execTasks(pwa_EventLoop *loop, int polled) {
+  if (!polled) return 0;
+  int n;
+#ifdef PWA_URING
+  if (loop->backend == pwa_Backend_uring) n = _pwa_Uring_execTasks(loop);
+  else
+#endif
+#ifdef PWA_EPOLL
+  if (loop->backend == pwa_Backend_epoll) n = _pwa_EventLoop_execEpollTasks(loop, polled);
+  else
+#endif
+  n = _pwa_EventLoop_execPollTasks(loop, polled);
+  for (pwa_PollSet *set = loop->firedSets; set; set = set->nextFired) _pwa_EventLoop_removeFds(loop, set);
+  loop->firedSets = 0;
+  return n;
+}
+
+// if job is parked on the task bounded by the deadline (possibly, through outer ones)
+static int _pwa_EventLoop_parkedOn(pwa_Iterator *iter, pwa_Deadline *deadline) {
+  if (!(iter->state & pwa_Task_await_bit)) return 0;
+  int task = (iter->state >> pwa_Task_await_shift) & pwa_Task_await_mask;
+  for (pwa_Deadline *d = (pwa_Deadline *) iter->tag; task == pwa_Task_deadline; d = (pwa_Deadline *) d->desc) {
+    if (d == deadline) return 1;
+    task = d->task;
+  }
+  return 0;
+}
+
+#ifdef PWA_METRICS
+static inline void _pwa_EventLoop_countLate(pwa_EventLoop *loop, struct timespec *until) {
+  struct timespec late;
+  pwa_timespec_diff(&late, &loop->now, until);
+  unsigned long long usec = late.tv_sec * 1000000ull + late.tv_nsec / 1000;
+  int bucket = usec ? 64 - __builtin_clzll(usec) : 0;
+  ++loop->metrics.nLate[bucket < pwa_EventLoop_nLateBuckets ? bucket : pwa_EventLoop_nLateBuckets - 1];
+}
+#endif
+
 int pwa_EventLoop_execDelays(pwa_EventLoop *loop) {
   int n = loop->nDelays;
   if (!n) return 0;
 
-  struct timespec now;
   pwa_Iterator *iter;
-  pwa_Task_Delay *delay = loop->delays;
+  pwa_Timer *timer;
   int nRan = 0;
 
-  if (clock_gettime(CLOCK_MONOTONIC, &now)) { return -2; };
-  for (int i = 0; i < n; ++i, ++delay) {
-    if (pwa_timespec_cmp(&now, &delay->until) < 0) continue;
-    iter = delay->iterator;
+  while (loop->nDelays && pwa_timespec_cmp(&loop->now, &loop->delays->until) >= 0) {
+    iter = loop->delays->iterator;
+    timer = loop->delays->timer;
     ++nRan;
-    iter->state &= pwa_Task_await_clear;
-    pwa_EventLoop_removeDelay(loop, i); --i; --n; --delay;
-    pwa_EventLoop_addAsync(loop, iter, 0);
+    _pwa_EventLoop_count(_pwa_EventLoop_countLate(loop, &loop->delays->until));
+    pwa_EventLoop_removeDelay(loop, 0);
+    if (timer->deadline) { // job is resumed, once its task is cancelled; offload is bounded only when it's done
+      pwa_Deadline *d = (pwa_Deadline *) timer;
+      if (!_pwa_EventLoop_parkedOn(iter, d)) { d->timedOut = 1; continue; } // running one sees it on next park
+      int unparked = _pwa_EventLoop_unparkTask(loop, iter, d->task, d->desc, pwa_Task_post_resume);
+      if (!unparked) continue;
+      d->timedOut = 1;
+      if (unparked > 1) continue; // resumed, once its I/O op is cancelled
+    }
+    _pwa_EventLoop_resume(loop, iter);
   }
 
   return nRan;
 }
 
-ssize_t pwa_EventLoop_run(pwa_EventLoop *loop) {
+// take the whole batch of posts at once; apply in order of posting
+int pwa_EventLoop_execPosts(pwa_EventLoop *loop) {
+  pwa_EventLoop_Post *post = __atomic_exchange_n(&loop->posts, 0, __ATOMIC_ACQUIRE), *next, *prev = 0;
+  int n = 0;
+  if (!post) return 0;
+  for (; post; post = next) { next = post->next; post->next = prev; prev = post; }
+  for (post = prev; post; post = next, ++n) {
+    next = post->next;
+    if (post->hit.how == pwa_Task_post_resume) { // offload is done
+      __atomic_sub_fetch(&loop->nHolds, 1, __ATOMIC_ACQ_REL);
+      _pwa_EventLoop_resume(loop, post->hit.iterator);
+      continue;
+    }
+    pwa_Task_HitJob hit = post->hit;
+    __atomic_store_n(&post->hit.iterator, 0, __ATOMIC_RELEASE); // the poster may reuse it from now on
+    if (hit.how == pwa_Task_post_job) _pwa_EventLoop_enqueueAsync(loop, hit.iterator);
+    else pwa_EventLoop_hitJob(loop, 0, &hit);
+  }
+  return n;
+}
+
+#ifdef PWA_METRICS
+static inline unsigned long long _pwa_EventLoop_nsec(struct timespec *a, struct timespec *b) {
+  struct timespec d;
+  pwa_timespec_diff(&d, a, b);
+  return d.tv_sec < 0 ? 0 : d.tv_sec * 1000000000ull + d.tv_nsec;
+}
+#endif
+
+// one loop turn: wait for events or nearest deadline, then resume woken up jobs
+ssize_t pwa_EventLoop_turn(pwa_EventLoop *loop) {
   int timeoutMsec, n;
   struct timespec span;
   ssize_t nRan = 0;
 
-  while (loop->nTasks || loop->nDelays) {
-    timeoutMsec = pwa_EventLoop_getWaitTimeout(loop, &span);
-    n = pwa_EventLoop_pollEvents(loop, &span, timeoutMsec);
-    if (n < 0) return n;
-    n = pwa_EventLoop_execTasks(loop, n);
-    if (n < 0) return n;
-    nRan += n;
-    n = pwa_EventLoop_execDelays(loop);
+  if (!pwa_EventLoop_updateNow(loop)) return -1;
+  // every job, that may be resumed by events, fits into run queue; otherwise they stay parked, and no event is taken
+  if (_pwa_EventLoop_reserveQueue(loop, loop->nTasks + loop->nOps + loop->nDelays)) return -4;
+#ifdef PWA_METRICS
+  struct timespec waitedAt = loop->now;
+  pwa_EventLoop_Metrics *m = &loop->metrics;
+  ++m->nTurns;
+  m->runNsec += _pwa_EventLoop_nsec(&loop->now, &loop->wokeAt);
+  if (loop->nTasks + loop->nOps > m->peakTasks) m->peakTasks = loop->nTasks + loop->nOps;
+  if (loop->nDelays > m->peakDelays) m->peakDelays = loop->nDelays;
+#endif
+  timeoutMsec = pwa_EventLoop_getWaitTimeout(loop, &span);
+  n = pwa_EventLoop_pollEvents(loop, &span, timeoutMsec);
+  if (n < 0) return n;
+  if (timeoutMsec && !pwa_EventLoop_updateNow(loop)) return -1; // clock only moved while waiting
+#ifdef PWA_METRICS
+  if (timeoutMsec && !n) ++m->nEmptyWakeups;
+  m->waitNsec += _pwa_EventLoop_nsec(&loop->now, &waitedAt);
+  loop->wokeAt = loop->now;
+#endif
+  n = pwa_EventLoop_execTasks(loop, n);
+  if (n < 0) return n;
+  nRan += n;
+  n = pwa_EventLoop_execDelays(loop);
+  if (n < 0) return n;
+  nRan += n;
+  pwa_EventLoop_execPosts(loop);
+  pwa_EventLoop_execQueue(loop);
+  return nRan;
+}
+
+#define pwa_EventLoop_hasJobs(loop) ((loop)->nTasks || (loop)->nDelays || (loop)->nOps || (loop)->nQueued || \
+  __atomic_load_n(&(loop)->posts, __ATOMIC_ACQUIRE) || __atomic_load_n(&(loop)->nHolds, __ATOMIC_ACQUIRE))
+
+void pwa_EventLoop_getMetrics(pwa_EventLoop *loop, pwa_EventLoop_Metrics *dst) {
+#ifdef PWA_METRICS
+  *dst = loop->metrics;
+#else
+  memset(dst, 0, sizeof(*dst));
+#endif
+}
+
+ssize_t pwa_EventLoop_run(pwa_EventLoop *loop) {
+  ssize_t n, nRan = 0;
+
+  while (1) {
+    if (!pwa_EventLoop_hasJobs(loop)) {
+      if (!loop->waits) break;
+      // nothing is left to wake jobs parked in wait lists: they are finished, so that their `finally` runs
+      _pwa_EventLoop_hitWaits(loop, pwa_Task_hit_finish);
+    }
+    n = pwa_EventLoop_turn(loop);
     if (n < 0) return n;
     nRan += n;
   }
@@ -263,6 +1712,683 @@ ssize_t pwa_EventLoop_run(pwa_EventLoop *loop) {
   return nRan;
 }
 
+// event loop group
+
+#ifdef PWA_THREADS
+
+int pwa_EventLoopGroup_init(pwa_EventLoopGroup *group, pwa_EventLoopGroup_Config *config) {
+  int n = config->nLoops;
+  if (n <= 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n <= 0) n = 1;
+  group->loops = (pwa_EventLoop *) malloc(n * sizeof(pwa_EventLoop));
+  if (!group->loops) return -1;
+  group->nLoops = n;
+  group->nIdle = group->nextLoop = 0;
+  group->pin = config->pin;
+  group->stop = 0;
+  pwa_EventLoop_Config loopConfig = config->loop;
+  size_t slice = (config->loop.arenaSize / n) & ~(size_t) 15; // each loop gets own part of arena
+  for (int i = 0; i < n; ++i) {
+    pwa_EventLoop *loop = group->loops + i;
+    if (config->loop.arena) {
+      loopConfig.arena = (char *) config->loop.arena + i * slice;
+      loopConfig.arenaSize = slice;
+    }
+    int res = pwa_EventLoop_initConfig(loop, &loopConfig);
+    loop->group = group;
+    if (res || _pwa_EventLoop_initWake(loop)) {
+      for (int j = 0; j <= i; ++j) pwa_EventLoop_free(group->loops + j);
+      free(group->loops);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void pwa_EventLoopGroup_free(pwa_EventLoopGroup *group) {
+  for (int i = 0; i < group->nLoops; ++i) pwa_EventLoop_free(group->loops + i);
+  free(group->loops);
+  group->loops = 0;
+  group->nLoops = 0;
+}
+
+void pwa_EventLoopGroup_addAsync(pwa_EventLoopGroup *group, pwa_Iterator *iter) {
+  pwa_EventLoop *loop = group->loops + group->nextLoop;
+  group->nextLoop = (group->nextLoop + 1) % group->nLoops;
+  _pwa_EventLoop_enqueueAsync(loop, iter);
+}
+
+// take older half of run queue of the most loaded sibling
+static int _pwa_EventLoopGroup_steal(pwa_EventLoop *loop) {
+  pwa_EventLoopGroup *group = loop->group;
+  pwa_EventLoop *victim = 0;
+  int max = 0;
+  for (int i = 0; i < group->nLoops; ++i) {
+    pwa_EventLoop *other = group->loops + i;
+    int n = __atomic_load_n(&other->nQueued, __ATOMIC_RELAXED);
+    if (other != loop && n > max) { max = n; victim = other; }
+  }
+  if (!victim) return 0;
+
+  // both queues are locked in address order, so that two loops stealing from each other don't deadlock
+  int nStolen = 0;
+  _pwa_EventLoop_lockQueue(victim < loop ? victim : loop);
+  _pwa_EventLoop_lockQueue(victim < loop ? loop : victim);
+  int n = (victim->nQueued + 1) >> 1;
+  for (; nStolen < n; ++nStolen) {
+    pwa_Iterator *iter = _pwa_EventLoop_popQueue(victim);
+    if (iter && _pwa_EventLoop_pushQueue(loop, iter)) { _pwa_EventLoop_pushQueue(victim, iter); break; } // has room
+  }
+  _pwa_EventLoop_unlockQueue(loop);
+  _pwa_EventLoop_unlockQueue(victim);
+  return nStolen;
+}
+
+// wake up a sibling waiting for work, when this loop has more queued jobs than it runs right away
+static void _pwa_EventLoopGroup_share(pwa_EventLoop *loop) {
+  pwa_EventLoopGroup *group = loop->group;
+  if (__atomic_load_n(&loop->nQueued, __ATOMIC_RELAXED) < 2) return;
+  for (int i = 0; i < group->nLoops; ++i) {
+    pwa_EventLoop *other = group->loops + i;
+    if (other != loop && __atomic_exchange_n(&other->hungry, 0, __ATOMIC_ACQ_REL)) {
+      pwa_EventLoop_wake(other);
+      return;
+    }
+  }
+}
+
+static void _pwa_EventLoopGroup_pin(int cpu) {
+#if defined __linux__ && defined SYS_sched_setaffinity
+  unsigned long mask[16] = { 0 };
+  int bits = 8 * sizeof(unsigned long);
+  if (cpu >= (int) (sizeof(mask) * 8)) return;
+  mask[cpu / bits] = 1ul << (cpu % bits);
+  syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+#endif
+}
+
+// loop counted idle may have been posted to by a sibling before it went idle too, and not be woken yet
+static int _pwa_EventLoopGroup_pending(pwa_EventLoopGroup *group) {
+  for (int i = 0; i < group->nLoops; ++i) {
+    pwa_EventLoop *loop = group->loops + i;
+    if (__atomic_load_n(&loop->posts, __ATOMIC_ACQUIRE) || __atomic_load_n(&loop->nQueued, __ATOMIC_RELAXED) ||
+      __atomic_load_n(&loop->nHolds, __ATOMIC_ACQUIRE)) return 1;
+  }
+  return 0;
+}
+
+static void * _pwa_EventLoopGroup_thread(void *arg) {
+  pwa_EventLoop *loop = (pwa_EventLoop *) arg;
+  pwa_EventLoopGroup *group = loop->group;
+  ssize_t n, nRan = 0;
+
+  if (group->pin) _pwa_EventLoopGroup_pin((int) (loop - group->loops));
+
+  while (!__atomic_load_n(&group->stop, __ATOMIC_ACQUIRE)) {
+    if (!loop->nQueued) {
+      __atomic_store_n(&loop->hungry, 1, __ATOMIC_RELEASE);
+      if (_pwa_EventLoopGroup_steal(loop)) __atomic_store_n(&loop->hungry, 0, __ATOMIC_RELAXED);
+    }
+    if (!pwa_EventLoop_hasJobs(loop)) { // idle: the last one to become idle stops the group
+      if (__atomic_add_fetch(&group->nIdle, 1, __ATOMIC_ACQ_REL) == group->nLoops && !_pwa_EventLoopGroup_pending(group)) {
+        __atomic_store_n(&group->stop, 1, __ATOMIC_RELEASE);
+        for (int i = 0; i < group->nLoops; ++i) pwa_EventLoop_wake(group->loops + i);
+        break;
+      }
+      struct pollfd wake = { loop->wakeFd, POLLIN, 0 };
+      if (poll(&wake, 1, -1) > 0) _pwa_EventLoop_drainWake(loop);
+      __atomic_sub_fetch(&group->nIdle, 1, __ATOMIC_ACQ_REL);
+      continue;
+    }
+    n = pwa_EventLoop_turn(loop);
+    if (n < 0) { nRan = n; break; }
+    nRan += n;
+    _pwa_EventLoopGroup_share(loop);
+  }
+
+  return (void *) nRan;
+}
+
+ssize_t pwa_EventLoopGroup_run(pwa_EventLoopGroup *group) {
+  int n = group->nLoops;
+  pthread_t *threads = (pthread_t *) malloc(n * sizeof(pthread_t));
+  if (!threads) return -1;
+  group->stop = 0;
+  group->nIdle = 0;
+
+  int nStarted = 1;
+  for (; nStarted < n; ++nStarted) {
+    if (pthread_create(threads + nStarted, 0, _pwa_EventLoopGroup_thread, group->loops + nStarted)) break;
+  }
+  if (nStarted < n) group->nIdle = n - nStarted; // loops without thread are never busy
+
+  ssize_t nRan = (ssize_t) _pwa_EventLoopGroup_thread(group->loops), res = nRan < 0 ? nRan : 0;
+  for (int i = 1; i < nStarted; ++i) {
+    void *ret;
+    pthread_join(threads[i], &ret);
+    if ((ssize_t) ret < 0) res = (ssize_t) ret;
+    else nRan += (ssize_t) ret;
+  }
+  free(threads);
+  for (int i = 0; !res && i < n; ++i) { // finish jobs left in wait lists, as a single loop does
+    if (!group->loops[i].waits) continue;
+    ssize_t nLeft = pwa_EventLoop_run(group->loops + i);
+    if (nLeft < 0) res = nLeft;
+    else nRan += nLeft;
+  }
+  return res < 0 ? res : nRan;
+}
+
+#endif
+
+// worker pool: FIFO of offloads linked by `post.next`; each one is posted back to its loop when done
+
+#ifdef PWA_THREADS
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pwa_Offload *head, *tail;
+  pthread_t *threads;
+  int nThreads;
+  char stop;
+} _pwa_App_workers = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void * _pwa_App_worker(void *arg) {
+  pthread_mutex_lock(&_pwa_App_workers.lock);
+  while (1) {
+    while (!_pwa_App_workers.head && !_pwa_App_workers.stop) {
+      pthread_cond_wait(&_pwa_App_workers.ready, &_pwa_App_workers.lock);
+    }
+    pwa_Offload *offload = _pwa_App_workers.head;
+    if (!offload) break; // stopped and drained
+    _pwa_App_workers.head = (pwa_Offload *) offload->post.next;
+    if (!_pwa_App_workers.head) _pwa_App_workers.tail = 0;
+    pthread_mutex_unlock(&_pwa_App_workers.lock);
+    _pwa_Offload_exec(offload);
+    _pwa_EventLoop_pushPost(offload->loop, &offload->post);
+    pthread_mutex_lock(&_pwa_App_workers.lock);
+  }
+  pthread_mutex_unlock(&_pwa_App_workers.lock);
+  return 0;
+}
+
+// called with lock held
+static int _pwa_App_startWorkers(int n) {
+  if (_pwa_App_workers.nThreads) return 0;
+  if (n <= 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n <= 0) n = 1;
+  _pwa_App_workers.threads = (pthread_t *) malloc(n * sizeof(pthread_t));
+  if (!_pwa_App_workers.threads) return -1;
+  _pwa_App_workers.stop = 0;
+  for (int i = 0; i < n; ++i) {
+    if (pthread_create(_pwa_App_workers.threads + i, 0, _pwa_App_worker, 0)) break;
+    ++_pwa_App_workers.nThreads;
+  }
+  if (_pwa_App_workers.nThreads) return 0;
+  free(_pwa_App_workers.threads);
+  _pwa_App_workers.threads = 0;
+  return -1;
+}
+
+int pwa_App_startWorkers(int n) {
+  pthread_mutex_lock(&_pwa_App_workers.lock);
+  int res = _pwa_App_startWorkers(n);
+  pthread_mutex_unlock(&_pwa_App_workers.lock);
+  return res;
+}
+
+void pwa_App_stopWorkers(void) {
+  pthread_mutex_lock(&_pwa_App_workers.lock);
+  pthread_t *threads = _pwa_App_workers.threads;
+  int n = _pwa_App_workers.nThreads;
+  _pwa_App_workers.stop = 1;
+  pthread_cond_broadcast(&_pwa_App_workers.ready);
+  pthread_mutex_unlock(&_pwa_App_workers.lock);
+  for (int i = 0; i < n; ++i) pthread_join(threads[i], 0);
+  pthread_mutex_lock(&_pwa_App_workers.lock);
+  free(threads);
+  _pwa_App_workers.threads = 0;
+  _pwa_App_workers.nThreads = 0;
+  _pwa_App_workers.stop = 0;
+  pthread_mutex_unlock(&_pwa_App_workers.lock);
+}
+
+static int _pwa_App_queueOffload(pwa_Offload *offload) {
+  pthread_mutex_lock(&_pwa_App_workers.lock);
+  if (_pwa_App_workers.stop || _pwa_App_startWorkers(pwa_App_defaultWorkers)) {
+    pthread_mutex_unlock(&_pwa_App_workers.lock);
+    return -1;
+  }
+  offload->post.next = 0;
+  if (_pwa_App_workers.tail) _pwa_App_workers.tail->post.next = &offload->post;
+  else _pwa_App_workers.head = offload;
+  _pwa_App_workers.tail = offload;
+  pthread_cond_signal(&_pwa_App_workers.ready);
+  pthread_mutex_unlock(&_pwa_App_workers.lock);
+  return 0;
+}
+
+#else
+
+int pwa_App_startWorkers(int n) { return -1; }
+void pwa_App_stopWorkers(void) {}
+static int _pwa_App_queueOffload(pwa_Offload *offload) { return -1; }
+
+#endif
+
+// channels
+
+int pwa_Chan_init(pwa_Chan *chan, int size, int itemSize) {
+  if (size <= 0 || itemSize <= 0) return -1;
+  chan->items = (char *) malloc((size_t) size * itemSize);
+  if (!chan->items) return -1;
+  chan->size = size;
+  chan->itemSize = itemSize;
+  chan->head = chan->n = 0;
+  chan->closed = 0;
+  chan->senders = chan->receivers = (pwa_WaitList) { 0, 0 };
+  return 0;
+}
+
+void pwa_Chan_free(pwa_Chan *chan) {
+  free(chan->items);
+  chan->items = 0;
+  chan->size = chan->n = 0;
+}
+
+int pwa_Chan_trySend(pwa_Chan *chan, const void *item) {
+  if (chan->closed) return -1;
+  if (chan->n == chan->size) return 0;
+  int i = chan->head + chan->n++;
+  if (i >= chan->size) i -= chan->size;
+  memcpy(chan->items + (size_t) i * chan->itemSize, item, chan->itemSize);
+  return 1;
+}
+
+int pwa_Chan_tryRecv(pwa_Chan *chan, void *item) {
+  if (!chan->n) return chan->closed ? -1 : 0;
+  memcpy(item, chan->items + (size_t) chan->head * chan->itemSize, chan->itemSize);
+  if (++chan->head == chan->size) chan->head = 0;
+  --chan->n;
+  return 1;
+}
+
+// synchronization
+
+void pwa_Sem_init(pwa_Sem *sem, int count) {
+  sem->count = count;
+  sem->waiters = (pwa_WaitList) { 0, 0, &sem->count };
+}
+
+int pwa_Sem_tryAcquire(pwa_Sem *sem) {
+  if (sem->count <= 0 || sem->waiters.first) return 0; // queued waiters go first
+  --sem->count;
+  return 1;
+}
+
+void pwa_Event_init(pwa_Event *event, char autoReset) {
+  event->set = 0;
+  event->autoReset = autoReset;
+  event->waiters = (pwa_WaitList) { 0, 0, autoReset ? &event->set : 0 };
+}
+
+// joins
+
+char *pwa_Join_errorMessages[sizeof(struct pwa_Join_errorLayout)] = {
+  "error: join alloc"
+};
+
+int pwa_Join_init(pwa_Join *join, char mode, void *iters, size_t iterSize, int n) {
+  *join = (pwa_Join) { .n = n, .first = -1, .mode = mode };
+  if (n <= 0) { join->n = 0; return 0; }
+  join->tasks = (pwa_JoinTask *) malloc(n * sizeof(pwa_JoinTask));
+  if (!join->tasks) return -1;
+  for (int i = 0; i < n; ++i) {
+    join->tasks[i] = pwa_iterate(pwa_JoinTask, ((pwa_Iterator *) ((char *) iters + i * iterSize), join, i));
+  }
+  return 0;
+}
+
+void pwa_Join_free(pwa_Join *join) {
+  free(join->tasks);
+  join->tasks = 0;
+}
+
+pwa_func_body(pwa_JoinTask) {
+  pwa_exec(*_->child);
+} pwa_finally {
+  if (!(_->child->state & _pwi_state_done_bit)) { // cancelled: finish the child from where it's parked
+    // `done` shares storage with `tag` of the task it's parked on
+    _->child->state &= pwa_Task_await_clear;
+    _->child->tag = 0;
+    pwa_finish_exec(*_->child);
+  }
+  if (_->child->error) {
+    if (!_->join->nFailed++ && _->join->mode == pwa_Join_all) _->join->first = _->index;
+  } else if (_->join->first < 0 && _->join->mode == pwa_Join_any) _->join->first = _->index;
+  if (_->join->first < 0 && _->join->mode == pwa_Join_race) _->join->first = _->index;
+  ++_->join->nDone;
+  pwa_task_await(pwa_Task_join, _->join)
+} pwa_end_func
+
+// file mapping
+
+#if ! defined _WIN32 || defined __CYGWIN__
+
+char *pwa_MapFile_errorMessages[sizeof(struct pwa_MapFile_errorLayout)] = {
+  "error: open", "error: stat", "error: mmap"
+};
+
+pwa_func_body(pwa_MapFile) {
+  _->map = 0;
+  if (_->name) {
+    _->fd = open(_->name, O_RDONLY | O_CLOEXEC);
+    if (_->fd == -1) { pwa_throw(pwa_error(pwa_MapFile, open)); }
+    _->ownsFd = 1;
+  }
+  struct stat st;
+  if (fstat(_->fd, &st)) { pwa_throw(pwa_error(pwa_MapFile, stat)); }
+  _->size = st.st_size;
+  if (!_->chunkSize) _->chunkSize = pwa_MapFile_defaultChunkSize;
+  if (_->chunkSize > 0x7fffffff) _->chunkSize = 0x7fffffff; // chunk size is `int`
+  if (!_->size) { pwa_return(((pwa_Chunk) { 0, 0 })); }
+
+  _->map = (char *) mmap(0, _->size, PROT_READ, MAP_PRIVATE, _->fd, 0);
+  if (_->map == MAP_FAILED) { _->map = 0; pwa_throw(pwa_error(pwa_MapFile, map)); }
+  madvise(_->map, _->size, MADV_SEQUENTIAL);
+
+  for (_->offset = 0; _->offset < _->size; _->offset += _->n) {
+    _->n = _->size - _->offset < _->chunkSize ? _->size - _->offset : _->chunkSize;
+    size_t ahead = (_->offset + _->n) & ~(size_t) (getpagesize() - 1); // read ahead the next chunk
+    if (ahead < _->size) madvise(_->map + ahead, _->size - ahead < _->chunkSize ? _->size - ahead : _->chunkSize, MADV_WILLNEED);
+    pwa_yield(((pwa_Chunk) { _->map + _->offset, (int) _->n }));
+  }
+} pwa_finally {
+  if (_->map) { munmap(_->map, _->size); _->map = 0; }
+  if (_->ownsFd) { close(_->fd); _->ownsFd = 0; }
+} pwa_end_func
+
+#endif
+
+// sockets
+
+#if ! defined _WIN32 || defined __CYGWIN__
+
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+int pwa_Socket_setNonBlock(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) ? -1 : 0;
+}
+
+int pwa_Socket_setNoDelay(int fd) {
+  int on = 1;
+  return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+int pwa_Socket_error(int fd) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len)) return errno;
+  return err;
+}
+
+int pwa_Socket_accept(int fd) {
+#if defined __linux__ && defined _GNU_SOURCE
+  return accept4(fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#elif defined __linux__ && defined SYS_accept4
+  return syscall(SYS_accept4, fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  int res = accept(fd, 0, 0);
+  if (res == -1) return -1;
+  fcntl(res, F_SETFD, FD_CLOEXEC);
+  if (pwa_Socket_setNonBlock(res)) { close(res); return -1; }
+  return res;
+#endif
+}
+
+int pwa_Socket_tcp(int family) {
+#ifdef SOCK_NONBLOCK
+  int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) return -1;
+#else
+  int fd = socket(family, SOCK_STREAM, 0);
+  if (fd == -1) return -1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  if (pwa_Socket_setNonBlock(fd)) { close(fd); return -1; }
+#endif
+  pwa_Socket_setNoDelay(fd);
+  return fd;
+}
+
+int pwa_Socket_listen(struct sockaddr *addr, socklen_t *addrLen, int backlog) {
+  int fd = pwa_Socket_tcp(addr->sa_family), on = 1;
+  if (fd == -1) return -1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (bind(fd, addr, *addrLen) || listen(fd, backlog) || getsockname(fd, addr, addrLen)) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+int pwa_Socket_addr4(struct sockaddr_in *dst, const char *ip, int port) {
+  memset(dst, 0, sizeof(*dst));
+  dst->sin_family = AF_INET;
+  dst->sin_port = htons(port);
+  if (!ip) { dst->sin_addr.s_addr = htonl(INADDR_ANY); return 0; }
+  return inet_pton(AF_INET, ip, &dst->sin_addr) == 1 ? 0 : -1;
+}
+
+// datagram batches
+
+int pwa_Datagrams_init(pwa_Datagrams *batch, int size, int bufSize) {
+  size_t msgsSize = _pwa_EventLoop_align(size * sizeof(pwa_Datagram));
+  size_t iovsSize = _pwa_EventLoop_align(size * sizeof(struct iovec));
+  size_t addrsSize = _pwa_EventLoop_align(size * sizeof(struct sockaddr_storage));
+  char *mem = (char *) calloc(1, msgsSize + iovsSize + addrsSize + (size_t) size * bufSize);
+  if (!mem) return -1;
+  batch->msgs = (pwa_Datagram *) mem;
+  batch->iovs = (struct iovec *) (mem + msgsSize);
+  batch->addrs = (struct sockaddr_storage *) (mem + msgsSize + iovsSize);
+  batch->bufs = mem + msgsSize + iovsSize + addrsSize;
+  batch->size = size;
+  batch->bufSize = bufSize;
+  batch->n = batch->sent = 0;
+  for (int i = 0; i < size; ++i) {
+    batch->iovs[i].iov_base = pwa_Datagrams_buf(batch, i);
+    batch->msgs[i].hdr.msg_iov = batch->iovs + i;
+    batch->msgs[i].hdr.msg_iovlen = 1;
+  }
+  return 0;
+}
+
+void pwa_Datagrams_free(pwa_Datagrams *batch) {
+  free(batch->msgs);
+  batch->msgs = 0;
+  batch->size = batch->n = batch->sent = 0;
+}
+
+int pwa_Datagrams_add(pwa_Datagrams *batch, const void *data, size_t len, const struct sockaddr *to, socklen_t toLen) {
+  if (batch->n == batch->size || len > (size_t) batch->bufSize || toLen > sizeof(struct sockaddr_storage)) return -1;
+  int i = batch->n++;
+  pwa_Datagram *msg = batch->msgs + i;
+  memcpy(batch->iovs[i].iov_base, data, len);
+  batch->iovs[i].iov_len = len;
+  if (to) memcpy(batch->addrs + i, to, toLen);
+  msg->hdr.msg_name = to ? batch->addrs + i : 0;
+  msg->hdr.msg_namelen = to ? toLen : 0;
+  msg->hdr.msg_control = 0;
+  msg->hdr.msg_controllen = 0;
+  msg->hdr.msg_flags = 0;
+  return 0;
+}
+
+int pwa_Datagrams_recv(int fd, pwa_Datagrams *batch, int flags) {
+  for (int i = 0; i < batch->size; ++i) { // kernel overwrites lengths
+    pwa_Datagram *msg = batch->msgs + i;
+    batch->iovs[i].iov_len = batch->bufSize;
+    msg->hdr.msg_name = batch->addrs + i;
+    msg->hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    msg->hdr.msg_control = 0;
+    msg->hdr.msg_controllen = 0;
+  }
+  batch->sent = 0;
+#if defined __linux__ && defined SYS_recvmmsg
+  int n = syscall(SYS_recvmmsg, fd, batch->msgs, batch->size, flags | MSG_DONTWAIT, NULL);
+#else
+  int n = 0;
+  for (ssize_t res; n < batch->size; ++n) {
+    if ((res = recvmsg(fd, &batch->msgs[n].hdr, flags | MSG_DONTWAIT)) == -1) break;
+    batch->msgs[n].len = res;
+  }
+  if (!n) n = -1;
+#endif
+  batch->n = n > 0 ? n : 0;
+  return n;
+}
+
+int pwa_Datagrams_send(int fd, pwa_Datagrams *batch) {
+  int n;
+#if defined __linux__ && defined SYS_sendmmsg
+  n = syscall(SYS_sendmmsg, fd, batch->msgs + batch->sent, batch->n - batch->sent, MSG_DONTWAIT);
+#else
+  n = 0;
+  for (ssize_t res; batch->sent + n < batch->n; ++n) {
+    pwa_Datagram *msg = batch->msgs + batch->sent + n;
+    if ((res = sendmsg(fd, &msg->hdr, MSG_DONTWAIT)) == -1) break;
+    msg->len = res;
+  }
+  if (!n && batch->sent < batch->n) n = -1;
+#endif
+  if (n > 0) batch->sent += n;
+  return n;
+}
+
+pwa_func_body(pwa_RecvDatagrams) {
+  while (1) {
+    _->res = pwa_Datagrams_recv(_->fd, _->batch, _->flags);
+    if (_->res > 0) {
+      pwa_yield(_->batch);
+      continue;
+    }
+    if (_->res == 0 || errno == EINTR) continue;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) { pwa_throw(pwa_error(pwa_Io, recv)); }
+    pwa_await_fd(_->fd, POLLIN)
+    if (_->_pwa_poll.fds.revents & POLLNVAL) { errno = EBADF; pwa_throw(pwa_error(pwa_Io, recv)); }
+  }
+} pwa_end_func
+
+pwa_func_body(pwa_Accept) {
+  while (1) {
+    _->res = pwa_Socket_accept(_->fd);
+    if (_->res != -1) {
+      if (_->noDelay) pwa_Socket_setNoDelay(_->res);
+      pwa_yield(_->res);
+      continue;
+    }
+    if (errno == EINTR || errno == ECONNABORTED) continue;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) { pwa_throw(pwa_error(pwa_Io, accept)); }
+    pwa_await_fd(_->fd, POLLIN)
+    if (_->_pwa_poll.fds.revents & POLLNVAL) { errno = EBADF; pwa_throw(pwa_error(pwa_Io, accept)); }
+  }
+} pwa_end_func
+
+#endif
+
+// file tailing
+
+#ifdef __linux__
+
+char *pwa_TailFile_errorMessages[sizeof(struct pwa_TailFile_errorLayout)] = {
+  "error: inotify", "error: open", "error: read"
+};
+
+#define pwa_TailFile_fileEvents (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+#define pwa_TailFile_dirEvents (IN_CREATE | IN_MOVED_TO)
+
+// directory is watched to notice a new file under the name after rotation
+static int _pwa_TailFile_watchDir(int ifd, const char *name) {
+  char dir[PATH_MAX];
+  const char *slash = strrchr(name, '/');
+  size_t len = slash ? (size_t) (slash - name) : 0;
+  if (len >= sizeof(dir)) return -1;
+  if (slash && !len) strcpy(dir, "/");
+  else if (!slash) strcpy(dir, ".");
+  else { memcpy(dir, name, len); dir[len] = 0; }
+  return inotify_add_watch(ifd, dir, pwa_TailFile_dirEvents) == -1 ? -1 : 0;
+}
+
+static void _pwa_TailFile_drain(int ifd) { // events only trigger a recheck of file
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (read(ifd, events, sizeof(events)) > 0);
+}
+
+pwa_func_body(pwa_TailFile) {
+  struct stat st;
+  if (!_->chunkSize) _->chunkSize = pwa_TailFile_defaultChunkSize;
+  _->buf = (char *) malloc(_->chunkSize);
+  if (!_->buf) { pwa_throw(pwa_error(pwa_TailFile, read)); }
+  _->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_->ifd == -1) { pwa_throw(pwa_error(pwa_TailFile, init)); }
+  _->hasIfd = 1;
+  if (_pwa_TailFile_watchDir(_->ifd, _->name)) { pwa_throw(pwa_error(pwa_TailFile, init)); }
+
+  _->fd = open(_->name, O_RDONLY | O_CLOEXEC);
+  if (_->fd == -1 || fstat(_->fd, &st)) { pwa_throw(pwa_error(pwa_TailFile, open)); }
+  _->hasFd = 1;
+  if (inotify_add_watch(_->ifd, _->name, pwa_TailFile_fileEvents) == -1) { pwa_throw(pwa_error(pwa_TailFile, init)); }
+  _->dev = st.st_dev;
+  _->ino = st.st_ino;
+  _->offset = _->fromStart ? 0 : st.st_size;
+
+  pwa_watch_fd(_->ifd, POLLIN);
+  _->watching = 1;
+
+  while (1) {
+    _->n = pread(_->fd, _->buf, _->chunkSize, _->offset);
+    if (_->n > 0) {
+      _->offset += _->n;
+      pwa_yield(((pwa_Chunk) { _->buf, (int) _->n }));
+      continue;
+    }
+    if (_->n == -1) {
+      if (errno == EINTR) continue;
+      pwa_throw(pwa_error(pwa_TailFile, read));
+    }
+
+    // at the end: check for truncation and rotation before waiting
+    if (!fstat(_->fd, &st) && st.st_size < _->offset) { _->offset = 0; continue; }
+    if (!stat(_->name, &st) && (st.st_dev != _->dev || st.st_ino != _->ino)) {
+      int fd = open(_->name, O_RDONLY | O_CLOEXEC);
+      if (fd != -1 && !fstat(fd, &st)) {
+        close(_->fd);
+        _->fd = fd;
+        _->dev = st.st_dev;
+        _->ino = st.st_ino;
+        _->offset = 0;
+        inotify_add_watch(_->ifd, _->name, pwa_TailFile_fileEvents);
+        continue;
+      }
+      if (fd != -1) close(fd);
+    }
+
+    pwa_await_fd(_->ifd, POLLIN);
+    _pwa_TailFile_drain(_->ifd);
+  }
+} pwa_finally {
+  if (_->watching) { _->watching = 0; pwa_unwatch_fd(_->ifd); }
+  if (_->hasIfd) { close(_->ifd); _->hasIfd = 0; }
+  if (_->hasFd) { close(_->fd); _->hasFd = 0; }
+  if (_->buf) { free(_->buf); _->buf = 0; }
+} pwa_end_func
+
+#endif
+
 int pwa_App_handleSignals(int n, int* signals, void (*handler)(int)) {
   struct sigaction new_action, old_action;
   int *signal = signals, handled = 0;
@@ -284,5 +2410,73 @@ int pwa_App_handleSignals(int n, int* signals, void (*handler)(int)) {
 int exitSignals[] = { SIGINT, SIGHUP, SIGTERM };
 
 int pwa_App_handleExitSignals(void (*handler)(int)) {
-  return pwa_App_handleSignals(sizeof(exitSignals), exitSignals, handler);
+  return pwa_App_handleSignals(sizeof(exitSignals) / sizeof(int), exitSignals, handler);
+}
+
+// signals as loop events
+
+int pwa_App_signalFd = -1;
+
+#ifdef __linux__
+
+static sigset_t _pwa_App_watchedSignals;
+
+int pwa_App_watchSignals(int n, int *signals) {
+  if (pwa_App_signalFd == -1) sigemptyset(&_pwa_App_watchedSignals);
+  for (int i = 0; i < n; ++i) sigaddset(&_pwa_App_watchedSignals, signals[i]);
+  if (sigprocmask(SIG_BLOCK, &_pwa_App_watchedSignals, NULL)) return -1;
+  int fd = signalfd(pwa_App_signalFd, &_pwa_App_watchedSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd == -1) return -1;
+  pwa_App_signalFd = fd;
+  return 0;
+}
+
+int pwa_App_readSignal(void) {
+  struct signalfd_siginfo info;
+  if (pwa_App_signalFd == -1) return -1;
+  if (read(pwa_App_signalFd, &info, sizeof(info)) == sizeof(info)) return info.ssi_signo;
+  return errno == EAGAIN ? 0 : -1;
+}
+
+#else
+
+static int _pwa_App_signalWriteFd = -1;
+
+static void _pwa_App_signalToPipe(int signum) { // async-signal-safe: a single write
+  unsigned char c = signum;
+  int savedErrno = errno;
+  if (write(_pwa_App_signalWriteFd, &c, 1) == -1) {}
+  errno = savedErrno;
+}
+
+int pwa_App_watchSignals(int n, int *signals) {
+  if (pwa_App_signalFd == -1) {
+    int fds[2];
+    if (pipe(fds)) return -1;
+    for (int i = 0; i < 2; ++i) {
+      fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+      fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    _pwa_App_signalWriteFd = fds[1];
+    pwa_App_signalFd = fds[0];
+  }
+  struct sigaction action;
+  action.sa_handler = _pwa_App_signalToPipe;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  for (int i = 0; i < n; ++i) if (sigaction(signals[i], &action, NULL)) return -1;
+  return 0;
+}
+
+int pwa_App_readSignal(void) {
+  unsigned char c;
+  if (pwa_App_signalFd == -1) return -1;
+  if (read(pwa_App_signalFd, &c, 1) == 1) return c;
+  return errno == EAGAIN ? 0 : -1;
+}
+
+#endif
+
+int pwa_App_watchExitSignals(void) {
+  return pwa_App_watchSignals(sizeof(exitSignals) / sizeof(int), exitSignals);
 }